@@ -0,0 +1,90 @@
+/*
+ * Strategy code written as "send order, await ack, await fill": one order lifecycle driven through
+ * `fsm::Awaitable` with nobody waiting vs. with a `fsm::Task` awaiting placement and fill. The difference is the cost
+ * of starting the coroutine (its frame comes from the frame pool) and of suspending and resuming it twice.
+ * Awaiting a partial fill that a single fill of the whole volume passes through on its way to Filled.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/Awaitable.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace await_transitions {
+    using namespace orderfsm;
+    using Order = fsm::Awaitable<OrderFSM<OrderType::LIMIT, OrderSide::BUY>>;
+
+    fsm::Task strategy(Order& order, int& filled) {
+        co_await order.until<State::Placed>();
+        co_await order.until<State::Filled>();
+        filled++;
+    }
+
+    // The fill raises `Filled` from within `process`, so FilledPartially is left before `process` returns. Waiting
+    // for it again right after must not be satisfied by that same call.
+    fsm::Task await_partial_fill(Order& order, int& partially_filled) {
+        co_await order.until<State::FilledPartially>();
+        partially_filled++;
+        co_await order.until<State::FilledPartially>();
+        partially_filled++;
+    }
+
+    void run_lifecycle(Order& order) {
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+        order.process(Event::PartiallyFilled{1});
+        order.process(Event::PartiallyFilled{1});
+    }
+}
+
+static void ProcessLifecycle(benchmark::State& state) {
+    using namespace await_transitions;
+    auto account = AccountManager(0, 0);
+
+    for (auto _ : state) {
+        Order order(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, 1, account, 10, 2);
+        run_lifecycle(order);
+        benchmark::DoNotOptimize(order);
+    }
+}
+BENCHMARK(ProcessLifecycle);
+
+static void AwaitLifecycle(benchmark::State& state) {
+    using namespace await_transitions;
+    auto account = AccountManager(0, 0);
+    int filled = 0;
+
+    for (auto _ : state) {
+        Order order(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, 1, account, 10, 2);
+        auto task = strategy(order, filled);
+        run_lifecycle(order);
+        benchmark::DoNotOptimize(order);
+    }
+    if (filled != state.iterations())
+        state.SkipWithError("strategy was not resumed on fill");
+}
+BENCHMARK(AwaitLifecycle);
+
+static void AwaitPassedState(benchmark::State& state) {
+    using namespace await_transitions;
+    auto account = AccountManager(0, 0);
+    int partially_filled = 0;
+
+    for (auto _ : state) {
+        Order order(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, 1, account, 10, 10);
+        auto task = await_partial_fill(order, partially_filled);
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+        order.process(Event::PartiallyFilled{10});
+        if (!order.is_in<State::Filled>())
+            state.SkipWithError("the order was not filled");
+        benchmark::DoNotOptimize(order);
+    }
+    if (partially_filled != state.iterations())
+        state.SkipWithError("strategy was not resumed exactly once by the fill passing through FilledPartially");
+}
+BENCHMARK(AwaitPassedState);
+
+
+BENCHMARK_MAIN();
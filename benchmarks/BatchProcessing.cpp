@@ -0,0 +1,96 @@
+/*
+ * Bursts of execution reports for random orders in a `fsm::FsmPool`: one `process` call per event vs.
+ * `process_batch`, which prefetches the instances targeted a few events ahead.
+ */
+
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/FsmPool.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace batch_processing {
+    using namespace orderfsm;
+
+    constexpr std::size_t BATCH_SIZE = 50000;
+
+    // per-instance data of a pooled order
+    struct PooledOrder {
+        int price{};
+        int volume{};
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) { return {}; }
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) { return {}; }
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event) {
+            volume -= event.volume;
+            return {};
+        }
+        State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event) {
+            volume -= event.volume;
+            return {};
+        }
+    };
+
+    using Pool = fsm::FsmPool<PooledOrder, states>;
+    using Batch = std::vector<std::pair<Pool::Handle, events>>;
+
+    // every order is parked in FilledPartially
+    Pool get_pool(std::size_t number_orders) {
+        Pool pool;
+        pool.reserve(number_orders);
+        for (std::size_t i = 0; i < number_orders; i++) {
+            auto handle = pool.emplace(10, 100);
+            pool.process(handle, Event::PlaceOrderReqACK{});
+            pool.process(handle, Event::OrderPlacedInOrderBook{});
+            pool.process(handle, Event::PartiallyFilled{0});
+        }
+        return pool;
+    }
+
+    Batch get_batch(std::size_t number_orders) {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<Pool::Handle> pick(0, static_cast<Pool::Handle>(number_orders - 1));
+        Batch batch;
+        batch.reserve(BATCH_SIZE);
+        for (std::size_t i = 0; i < BATCH_SIZE; i++)
+            batch.emplace_back(pick(rng), Event::PartiallyFilled{0});
+        return batch;
+    }
+}
+
+static void OneByOne(benchmark::State& state) {
+    auto number_orders = static_cast<std::size_t>(state.range(0));
+    auto pool = batch_processing::get_pool(number_orders);
+    auto batch = batch_processing::get_batch(number_orders);
+
+    for (auto _ : state) {
+        std::size_t transitioned = 0;
+        for (auto& [handle, event] : batch)
+            transitioned += pool.process(handle, event) == fsm::Result::Transitioned;
+        benchmark::DoNotOptimize(transitioned);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch.size()));
+}
+BENCHMARK(OneByOne)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+
+static void Batched(benchmark::State& state) {
+    auto number_orders = static_cast<std::size_t>(state.range(0));
+    auto pool = batch_processing::get_pool(number_orders);
+    auto batch = batch_processing::get_batch(number_orders);
+    auto batch_view = std::span<const batch_processing::Batch::value_type>(batch);
+
+    for (auto _ : state) {
+        auto transitioned = pool.process_batch(batch_view);
+        benchmark::DoNotOptimize(transitioned);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch.size()));
+}
+BENCHMARK(Batched)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+
+BENCHMARK_MAIN();
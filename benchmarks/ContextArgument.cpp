@@ -0,0 +1,176 @@
+/*
+ * Fills for a million resting orders in random order. Every order storing a pointer to its account vs. the account
+ * passed once per batch as the context of `process(event, account)`: the second order is 8 bytes smaller, so the
+ * working set shrinks accordingly and no account pointer is loaded per fill. The same order without its state, kept
+ * in the columns of an `fsm::FsmPool` that forwards the account to it.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/FsmPool.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace context_argument {
+    using namespace orderfsm;
+
+    constexpr std::size_t NUMBER_ORDERS = 1 << 20;
+
+    class PointerOrder: public fsm::Fsm<PointerOrder, states, fsm::dispatch::JumpTable> {
+    public:
+        AccountManager* account;
+        int price{};
+        int volume{};
+
+        PointerOrder(AccountManager& account, int price, int volume): account(&account), price(price), volume(volume) {}
+
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event) { return fill(event); }
+        State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event) {
+            return fill(event);
+        }
+    private:
+        State::FilledPartially fill(const Event::PartiallyFilled& event) {
+            volume -= event.volume;
+            account->available_BTC += event.volume;
+            return {};
+        }
+    };
+
+    class ContextOrder: public fsm::Fsm<ContextOrder, states, fsm::dispatch::JumpTable> {
+    public:
+        using context = AccountManager;
+
+        int price{};
+        int volume{};
+
+        ContextOrder(AccountManager&, int price, int volume): price(price), volume(volume) {}
+
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event,
+                                          AccountManager& account) {
+            return fill(event, account);
+        }
+        State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event,
+                                          AccountManager& account) {
+            return fill(event, account);
+        }
+    private:
+        State::FilledPartially fill(const Event::PartiallyFilled& event, AccountManager& account) {
+            volume -= event.volume;
+            account.available_BTC += event.volume;
+            return {};
+        }
+    };
+
+    // the data of `ContextOrder` as a column of `fsm::FsmPool`, its state lives in the pool's state column
+    struct PooledContextOrder {
+        using context = AccountManager;
+
+        int price{};
+        int volume{};
+
+        PooledContextOrder(int price, int volume): price(price), volume(volume) {}
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) { return {}; }
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) { return {}; }
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event,
+                                          AccountManager& account) {
+            return fill(event, account);
+        }
+        State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event,
+                                          AccountManager& account) {
+            return fill(event, account);
+        }
+    private:
+        State::FilledPartially fill(const Event::PartiallyFilled& event, AccountManager& account) {
+            volume -= event.volume;
+            account.available_BTC += event.volume;
+            return {};
+        }
+    };
+
+    std::vector<std::uint32_t> get_order_indices() {
+        std::vector<std::uint32_t> indices(NUMBER_ORDERS);
+        std::iota(indices.begin(), indices.end(), 0);
+        std::shuffle(indices.begin(), indices.end(), std::mt19937(42));
+        return indices;
+    }
+
+    const std::vector<std::uint32_t> order_indices = get_order_indices();
+
+    template<typename TOrder>
+    std::vector<TOrder> get_orders(AccountManager& account) {
+        std::vector<TOrder> orders;
+        orders.reserve(NUMBER_ORDERS);
+        for (std::size_t i = 0; i < NUMBER_ORDERS; i++) {
+            auto& order = orders.emplace_back(account, 10, 1 << 30);
+            if constexpr (std::is_same_v<TOrder, ContextOrder>) {
+                order.process(Event::PlaceOrderReqACK{}, account);
+                order.process(Event::OrderPlacedInOrderBook{}, account);
+            } else {
+                order.process(Event::PlaceOrderReqACK{});
+                order.process(Event::OrderPlacedInOrderBook{});
+            }
+        }
+        return orders;
+    }
+}
+
+static void FillsWithAccountPointer(benchmark::State& state) {
+    using namespace context_argument;
+    auto account = AccountManager(0, 0);
+    auto orders = get_orders<PointerOrder>(account);
+    for (auto _ : state) {
+        for (auto index : order_indices)
+            orders[index].process(Event::PartiallyFilled{1});
+    }
+    benchmark::DoNotOptimize(account.available_BTC);
+    state.counters["order_bytes"] = sizeof(PointerOrder);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * NUMBER_ORDERS));
+}
+BENCHMARK(FillsWithAccountPointer)->Unit(benchmark::kMillisecond);
+
+static void FillsWithContext(benchmark::State& state) {
+    using namespace context_argument;
+    auto account = AccountManager(0, 0);
+    auto orders = get_orders<ContextOrder>(account);
+    for (auto _ : state) {
+        for (auto index : order_indices)
+            orders[index].process(Event::PartiallyFilled{1}, account);
+    }
+    benchmark::DoNotOptimize(account.available_BTC);
+    state.counters["order_bytes"] = sizeof(ContextOrder);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * NUMBER_ORDERS));
+}
+BENCHMARK(FillsWithContext)->Unit(benchmark::kMillisecond);
+
+static void FillsWithContextInFsmPool(benchmark::State& state) {
+    using namespace context_argument;
+    auto account = AccountManager(0, 0);
+    fsm::FsmPool<PooledContextOrder, states> pool;
+    pool.reserve(NUMBER_ORDERS);
+    for (std::size_t i = 0; i < NUMBER_ORDERS; i++)
+        pool.emplace(10, 1 << 30);
+    pool.process_all<State::Sent>(Event::PlaceOrderReqACK{}, account);
+    pool.process_all<State::Pending>(Event::OrderPlacedInOrderBook{}, account);
+    for (auto _ : state) {
+        for (auto index : order_indices)
+            pool.process(index, Event::PartiallyFilled{1}, account);
+    }
+    benchmark::DoNotOptimize(account.available_BTC);
+    // fills are only taken with the account, an order still placed didn't get it
+    if (!pool.is_in<State::FilledPartially>(order_indices.front()))
+        state.SkipWithError("the pool did not pass the account to the fills");
+    state.counters["order_bytes"] = sizeof(PooledContextOrder) + sizeof(decltype(pool)::StateIndex);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * NUMBER_ORDERS));
+}
+BENCHMARK(FillsWithContextInFsmPool)->Unit(benchmark::kMillisecond);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,110 @@
+/*
+ * Compaction of a dense pool of orders after a third of them were filled or cancelled: trivially relocatable order
+ * records slid down with one memmove per run of live orders vs. the same records moved one by one through their
+ * move constructor.
+ */
+
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/DensePool.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace dense_pool {
+    using namespace orderfsm;
+
+    constexpr std::size_t NUMBER_ORDERS = 100000;
+
+    // the same record, relocated by move construction and destruction
+    class MovedRecord: public OrderRecord {
+    public:
+        static constexpr bool trivially_relocatable = false;
+
+        using OrderRecord::OrderRecord;
+        MovedRecord(MovedRecord&& other) noexcept : OrderRecord(std::move(other)) {}
+    };
+
+    // Counts fills without leaving `Placed`: a fill returns `fsm::Stay`, and the one taking the last of the volume
+    // posts `Filled`, which ends the order before `process` returns `Result::Unchanged`.
+    class QuietFillOrder: public fsm::Fsm<QuietFillOrder, states, fsm::dispatch::Visit, fsm::policy::Ignore,
+                                          fsm::deferral::None, posted> {
+    public:
+        using events = orderfsm::events;
+
+        int volume{};
+
+        explicit QuietFillOrder(int volume): volume(volume) {}
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) { return {}; }
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) { return {}; }
+        fsm::OneOf<fsm::Stay> transition(State::Placed&, const Event::PartiallyFilled& event) {
+            volume -= event.volume;
+            if (volume == 0)
+                post(Event::Filled{0});
+            return fsm::Stay{};
+        }
+        State::Filled transition(State::Placed&, const Event::Filled&) { return {}; }
+    };
+
+    template<typename TRecord>
+    void fill_pool(fsm::DensePool<TRecord>& pool, AccountManager& account) {
+        std::mt19937 rng(42);
+        std::bernoulli_distribution finished(0.3);
+        pool.reserve(NUMBER_ORDERS);
+        std::vector<typename fsm::DensePool<TRecord>::Handle> handles;
+        for (std::size_t i = 0; i < NUMBER_ORDERS; i++) {
+            const auto handle = pool.emplace(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker,
+                                             static_cast<int>(i), account, 10, 2);
+            pool.process(handle, Event::PlaceOrderReqACK{}, account);
+            pool.process(handle, Event::OrderPlacedInOrderBook{}, account);
+            handles.push_back(handle);
+        }
+        for (auto handle : handles) {
+            if (finished(rng))
+                pool.process(handle, Event::Filled{2}, account);
+        }
+    }
+}
+
+template<typename TRecord>
+static void Compact(benchmark::State& state) {
+    auto account = orderfsm::AccountManager(0, 0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        fsm::DensePool<TRecord> pool;
+        dense_pool::fill_pool(pool, account);
+        state.ResumeTiming();
+        auto closed = pool.compact();
+        benchmark::DoNotOptimize(closed);
+    }
+
+    // a fill that stays but posts the end of the order destroys it as well
+    fsm::DensePool<dense_pool::QuietFillOrder> quiet;
+    const auto quiet_order = quiet.emplace(2);
+    quiet.process(quiet_order, orderfsm::Event::PlaceOrderReqACK{});
+    quiet.process(quiet_order, orderfsm::Event::OrderPlacedInOrderBook{});
+    if (quiet.process(quiet_order, orderfsm::Event::PartiallyFilled{2}) != fsm::Result::Unchanged || quiet.size() != 0)
+        state.SkipWithError("an order filled by a posted event was not destroyed");
+
+    // a good till date record expires like the order it stands in for, giving back the funds it still held
+    auto ledger = orderfsm::AccountManager(0, 0);
+    fsm::DensePool<TRecord> expiring;
+    const auto record = expiring.emplace(orderfsm::Exchange::CME, orderfsm::Market::BTCUSD,
+                                         orderfsm::TimeInForce{.good_till_date = true},
+                                         orderfsm::Strategy::IcebergPicker, 0, ledger, 10, 2);
+    expiring.process(record, orderfsm::Event::PlaceOrderReqACK{}, ledger);
+    expiring.process(record, orderfsm::Event::OrderPlacedInOrderBook{}, ledger);
+    if (expiring.process(record, orderfsm::Event::Expired{}, ledger) != fsm::Result::Transitioned
+        || expiring.size() != 0 || ledger.available_USD != 0)
+        state.SkipWithError("a good till date record did not expire");
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * dense_pool::NUMBER_ORDERS));
+}
+BENCHMARK(Compact<orderfsm::OrderRecord>)->Unit(benchmark::kMicrosecond);
+BENCHMARK(Compact<dense_pool::MovedRecord>)->Unit(benchmark::kMicrosecond);
+
+
+BENCHMARK_MAIN();
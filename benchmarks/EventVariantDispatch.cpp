@@ -0,0 +1,115 @@
+/*
+ * Runtime (decoded) events: a hand written switch over the event index followed by `Fsm::process<Event>`
+ * (std::visit over the state) vs. `Fsm::process(const EventVariant&)` resolving state and event in one table.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "OrderFSM.hpp"
+
+
+namespace event_variant {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+
+    constexpr int NUMBER_ORDERS = 1000;
+    constexpr int PRICE = 10;
+    constexpr int VOLUME = 1;
+
+    struct Step {
+        std::size_t order;
+        events event;
+    };
+
+    // even orders are parked in Placed, odd ones in FilledPartially
+    std::vector<Order> get_orders(AccountManager& account) {
+        std::vector<Order> orders;
+        orders.reserve(NUMBER_ORDERS);
+        for (int i = 0; i < NUMBER_ORDERS; i++) {
+            auto& order = orders.emplace_back(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker,
+                                              i, account, PRICE, VOLUME);
+            order.process(Event::PlaceOrderReqACK{});
+            order.process(Event::OrderPlacedInOrderBook{});
+            if (i % 2)
+                order.process(Event::PartiallyFilled{0});
+        }
+        return orders;
+    }
+
+    // every order receives a modification request ack in the first round and the modification ack in the second
+    // round, bringing it back to its parking state, so the schedule can be replayed forever
+    std::vector<Step> get_schedule() {
+        std::mt19937 rng(42);
+        std::vector<std::size_t> permutation(NUMBER_ORDERS);
+        std::vector<Step> schedule;
+        for (int round = 0; round < 2; round++) {
+            for (std::size_t i = 0; i < permutation.size(); i++)
+                permutation[i] = i;
+            std::shuffle(permutation.begin(), permutation.end(), rng);
+
+            for (auto i : permutation) {
+                if (round == 0)
+                    schedule.push_back({i, Event::PendingModificationACK{}});
+                else if (i % 2)
+                    schedule.push_back({i, Event::ModifiedPartiallyFilled{{PRICE, VOLUME}}});
+                else
+                    schedule.push_back({i, Event::ModifiedPlaced{PRICE, VOLUME}});
+            }
+        }
+        return schedule;
+    }
+
+    // what the execution report decoder has to do without the variant entry point
+    void process_two_stage(Order& order, const events& event) {
+        switch (event.index()) {
+            case 0: order.process(std::get<Event::PlaceOrderReqACK>(event)); break;
+            case 1: order.process(std::get<Event::PendingCancellationACK>(event)); break;
+            case 2: order.process(std::get<Event::PendingModificationACK>(event)); break;
+            case 3: order.process(std::get<Event::OrderPlacedInOrderBook>(event)); break;
+            case 4: order.process(std::get<Event::ModifiedPlaced>(event)); break;
+            case 5: order.process(std::get<Event::PartiallyFilled>(event)); break;
+            case 6: order.process(std::get<Event::ModifiedPartiallyFilled>(event)); break;
+            case 7: order.process(std::get<Event::Filled>(event)); break;
+            case 8: order.process(std::get<Event::Rejected>(event)); break;
+            case 9: order.process(std::get<Event::Cancelled>(event)); break;
+            case 10: order.process(std::get<Event::Expired>(event)); break;
+            default: break;
+        }
+    }
+}
+
+static void SwitchThenVisit(benchmark::State& state) {
+    auto account = orderfsm::AccountManager(0, 0);
+    auto orders = event_variant::get_orders(account);
+    auto schedule = event_variant::get_schedule();
+    std::size_t r = 0;
+
+    for (auto _ : state) {
+        auto& step = schedule[r++ % schedule.size()];
+        event_variant::process_two_stage(orders[step.order], step.event);
+        benchmark::DoNotOptimize(orders[step.order]);
+    }
+}
+BENCHMARK(SwitchThenVisit);
+
+
+static void FusedTable(benchmark::State& state) {
+    auto account = orderfsm::AccountManager(0, 0);
+    auto orders = event_variant::get_orders(account);
+    auto schedule = event_variant::get_schedule();
+    std::size_t r = 0;
+
+    for (auto _ : state) {
+        auto& step = schedule[r++ % schedule.size()];
+        orders[step.order].process(step.event);
+        benchmark::DoNotOptimize(orders[step.order]);
+    }
+}
+BENCHMARK(FusedTable);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,105 @@
+/*
+ * Session roll: expire every good till date order whose deadline has passed. One `Expired` per order object, with
+ * the deadline read from each order (array of structures), vs. `fsm::FsmPool::expire_before`, a vectorized scan of
+ * the pool's deadline column that only touches the matching orders.
+ */
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/FsmPool.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace expiry_sweep {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+
+    constexpr std::size_t NUMBER_ORDERS = 250000;
+    constexpr std::uint64_t HORIZON = 1'000'000;
+
+    // per-instance data of a pooled good till date order
+    struct PooledOrder {
+        int price{};
+        int volume{};
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) { return {}; }
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) { return {}; }
+        State::Expired transition(State::Placed&, const Event::Expired&) { return {}; }
+    };
+
+    using Pool = fsm::FsmPool<PooledOrder, states>;
+
+    std::vector<std::uint64_t> get_deadlines() {
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<std::uint64_t> pick(0, HORIZON - 1);
+        std::vector<std::uint64_t> deadlines(NUMBER_ORDERS);
+        for (auto& deadline : deadlines)
+            deadline = pick(rng);
+        return deadlines;
+    }
+
+    const std::vector<std::uint64_t> deadlines = get_deadlines();
+
+    std::vector<Order> get_orders(AccountManager& account) {
+        std::vector<Order> orders;
+        orders.reserve(NUMBER_ORDERS);
+        for (std::size_t i = 0; i < NUMBER_ORDERS; i++) {
+            auto& order = orders.emplace_back(Exchange::CME, Market::BTCUSD,
+                                              TimeInForce{false, false, false, true, deadlines[i]},
+                                              Strategy::IcebergPicker, static_cast<int>(i), account, 10, 1);
+            order.process(Event::PlaceOrderReqACK{});
+            order.process(Event::OrderPlacedInOrderBook{});
+        }
+        return orders;
+    }
+
+    Pool get_pool() {
+        Pool pool;
+        pool.reserve(NUMBER_ORDERS);
+        for (std::size_t i = 0; i < NUMBER_ORDERS; i++) {
+            auto handle = pool.emplace(10, 1);
+            pool.process(handle, Event::PlaceOrderReqACK{});
+            pool.process(handle, Event::OrderPlacedInOrderBook{});
+            pool.set_deadline(handle, deadlines[i]);
+        }
+        return pool;
+    }
+}
+
+// `state.range(0)` is the share of expiring orders in percent
+static void ExpireOneByOne(benchmark::State& state) {
+    const auto timestamp = expiry_sweep::HORIZON * static_cast<std::uint64_t>(state.range(0)) / 100;
+    auto account = orderfsm::AccountManager(0, 0);
+    std::size_t expired = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto orders = expiry_sweep::get_orders(account);
+        state.ResumeTiming();
+        for (auto& order : orders) {
+            if (order.time_in_force.expire_at < timestamp)
+                expired += order.process(orderfsm::Event::Expired{}) == fsm::Result::Transitioned;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(expired));
+}
+BENCHMARK(ExpireOneByOne)->Arg(1)->Arg(30)->Unit(benchmark::kMicrosecond);
+
+static void ExpireBefore(benchmark::State& state) {
+    const auto timestamp = expiry_sweep::HORIZON * static_cast<std::uint64_t>(state.range(0)) / 100;
+    std::size_t expired = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto pool = expiry_sweep::get_pool();
+        state.ResumeTiming();
+        expired += pool.expire_before(timestamp, orderfsm::Event::Expired{});
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(expired));
+}
+BENCHMARK(ExpireBefore)->Arg(1)->Arg(30)->Unit(benchmark::kMicrosecond);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,102 @@
+/*
+ * Cancel/replace churn: a window of live orders where every step places a new order and cancels the oldest one.
+ * Orders allocated one by one on the heap vs. `fsm::InstancePool`, which recycles an order into its huge page
+ * slabs as soon as it is cancelled.
+ */
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/InstancePool.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace instance_pool {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+    using Pool = fsm::InstancePool<Order>;
+
+    constexpr std::size_t LIVE_ORDERS = 4096;
+
+    template<typename TOrder>
+    void place(TOrder& order) {
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+    }
+
+    // Counts fills without leaving `Placed`: a fill returns `fsm::Stay`, and the one taking the last of the volume
+    // posts `Filled`, which ends the order before `process` returns `Result::Unchanged`.
+    class QuietFillOrder: public fsm::Fsm<QuietFillOrder, states, fsm::dispatch::Visit, fsm::policy::Ignore,
+                                          fsm::deferral::None, posted> {
+    public:
+        using events = orderfsm::events;
+
+        int volume{};
+
+        explicit QuietFillOrder(int volume): volume(volume) {}
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) { return {}; }
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) { return {}; }
+        fsm::OneOf<fsm::Stay> transition(State::Placed&, const Event::PartiallyFilled& event) {
+            volume -= event.volume;
+            if (volume == 0)
+                post(Event::Filled{0});
+            return fsm::Stay{};
+        }
+        State::Filled transition(State::Placed&, const Event::Filled&) { return {}; }
+    };
+}
+
+static void HeapChurn(benchmark::State& state) {
+    using namespace instance_pool;
+    auto account = AccountManager(0, 0);
+    std::vector<std::unique_ptr<Order>> orders(LIVE_ORDERS);
+    std::size_t oldest = 0;
+
+    for (auto _ : state) {
+        auto& order = orders[oldest++ % LIVE_ORDERS];
+        if (order) {
+            order->process(Event::PendingCancellationACK{});
+            order->process(Event::Cancelled{});
+        }
+        order = std::make_unique<Order>(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, 1,
+                                        account, 10, 2);
+        place(*order);
+        auto raw = order.get();
+        benchmark::DoNotOptimize(raw);
+    }
+}
+BENCHMARK(HeapChurn);
+
+static void InstancePoolChurn(benchmark::State& state) {
+    using namespace instance_pool;
+    auto account = AccountManager(0, 0);
+    Pool pool;
+    std::vector<Pool::Handle> orders(LIVE_ORDERS, Pool::NO_INSTANCE);
+    std::size_t oldest = 0;
+
+    for (auto _ : state) {
+        auto& handle = orders[oldest++ % LIVE_ORDERS];
+        pool.process(handle, Event::PendingCancellationACK{});
+        // cancelled, the order is recycled
+        pool.process(handle, Event::Cancelled{});
+        handle = pool.emplace(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, 1, account, 10, 2);
+        place(*pool.get(handle));
+        benchmark::DoNotOptimize(handle);
+    }
+    if (pool.size() > LIVE_ORDERS)
+        state.SkipWithError("cancelled orders were not recycled");
+
+    // a fill that stays but posts the end of the order recycles it as well
+    fsm::InstancePool<QuietFillOrder> quiet;
+    const auto quiet_order = quiet.emplace(2);
+    place(*quiet.get(quiet_order));
+    if (quiet.process(quiet_order, Event::PartiallyFilled{2}) != fsm::Result::Unchanged || quiet.size() != 0)
+        state.SkipWithError("an order filled by a posted event was not recycled");
+}
+BENCHMARK(InstancePoolChurn);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,87 @@
+/*
+ * Logging the fills of an order for crash recovery, made durable in batches of 64 and 4096 events. JSON lines
+ * written with `fprintf` and flushed with `fflush` + `fdatasync` vs. fixed-size binary records appended to a
+ * memory-mapped `fsm::Journal` segment and committed with one msync per batch.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <variant>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/Journal.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace journal {
+    using namespace orderfsm;
+
+    constexpr std::size_t SEGMENT_BYTES = std::size_t{16} << 20;
+
+    std::filesystem::path directory(const char* name) {
+        auto path = std::filesystem::temp_directory_path() / name;
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+        return path;
+    }
+}
+
+static void JsonLines(benchmark::State& state) {
+    using namespace journal;
+    const auto path = directory("fsm_journal_json");
+    auto file = std::fopen((path / "events.jsonl").c_str(), "w");
+    const auto events_per_commit = static_cast<std::uint64_t>(state.range(0));
+    std::uint64_t instance = 0;
+
+    for (auto _ : state) {
+        const events event = Event::PartiallyFilled{static_cast<int>(instance % 100)};
+        std::fprintf(file, "{\"instance\":%llu,\"event\":%zu,\"volume\":%d}\n",
+                     static_cast<unsigned long long>(instance), event.index(),
+                     std::get<Event::PartiallyFilled>(event).volume);
+        if (++instance % events_per_commit == 0) {
+            std::fflush(file);
+            fdatasync(fileno(file));
+        }
+    }
+    std::fclose(file);
+    std::filesystem::remove_all(path);
+}
+BENCHMARK(JsonLines)->Arg(64)->Arg(4096);
+
+static void JournalGroupCommit(benchmark::State& state) {
+    using namespace journal;
+    const auto path = directory("fsm_journal_binary");
+    {
+        fsm::Journal<events> journal(path, SEGMENT_BYTES, static_cast<std::size_t>(state.range(0)));
+        if (!journal.good())
+            state.SkipWithError("could not open a journal segment");
+        std::uint64_t instance = 0;
+
+        for (auto _ : state) {
+            const events event = Event::PartiallyFilled{static_cast<int>(instance % 100)};
+            auto appended = journal.append(instance++, event);
+            benchmark::DoNotOptimize(appended);
+        }
+        journal.commit();
+        std::size_t replayed = 0;
+        for (std::uint64_t sequence = 0; sequence <= journal.sequence(); sequence++)
+            replayed += fsm::Journal<events>::replay(fsm::Journal<events>::segment_path(path, sequence),
+                                                     [](std::uint64_t, std::uint64_t, const events&) {});
+        if (replayed != instance)
+            state.SkipWithError("appended events were not replayed");
+        // a missing segment before the last one doesn't make a reopened journal reuse its sequence
+        fsm::Journal<events> reopened(path, SEGMENT_BYTES);
+        std::filesystem::remove(fsm::Journal<events>::segment_path(path, journal.sequence()));
+        if (fsm::Journal<events>(path, SEGMENT_BYTES).sequence() != reopened.sequence() + 1)
+            state.SkipWithError("the reopened journal did not continue after the last segment");
+    }
+    std::filesystem::remove_all(path);
+}
+BENCHMARK(JournalGroupCommit)->Arg(64)->Arg(4096);
+
+
+BENCHMARK_MAIN();
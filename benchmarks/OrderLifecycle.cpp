@@ -0,0 +1,143 @@
+/*
+ * Cost of one order lifecycle (construction, ack, placement, partial fill, fill):
+ * transitions declared pure virtual on the base the `fsm::Fsm` is instantiated on vs. the concrete order type
+ * being the CRTP child, with the same data and transitions. The last benchmark runs the lifecycle on
+ * `orderfsm::OrderFSM`, which also carries deferral and posting queues and an expiry timer.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "OrderFSM.hpp"
+
+
+namespace virtual_order {
+    using namespace orderfsm;
+
+    // the previous layout of the order example: the fsm dispatches to the base, which forwards to the
+    // specialization through its vtable
+    class OrderBase: public fsm::Fsm<OrderBase, states> {
+    public:
+        AccountManager &account;
+        int price {};
+        int volume {};
+
+        OrderBase(AccountManager &account, int price, int volume): account(account), price(price), volume(volume) {}
+        virtual ~OrderBase() = default;
+
+        virtual State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) = 0;
+        virtual State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) = 0;
+        virtual State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled&) = 0;
+        virtual State::Filled transition(State::FilledPartially&, const Event::Filled&) = 0;
+    };
+
+    class Order: public OrderBase {
+    public:
+        Order(AccountManager &account, int price, int volume): OrderBase(account, price, volume) {
+            account.available_USD -= volume * price;
+        }
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) final {return State::Pending{};}
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) final {
+            return State::Placed{};}
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event_partially_filled) final {
+            volume -= event_partially_filled.volume;
+            account.available_BTC += event_partially_filled.volume;
+            return State::FilledPartially{};
+        }
+        State::Filled transition(State::FilledPartially&, const Event::Filled& event_filled) final {
+            volume = 0;
+            account.available_BTC += event_filled.volume;
+            return State::Filled{};
+        }
+    };
+
+    // the order is only known through its base, as it would be when stored polymorphically
+    [[gnu::noinline]] void run_lifecycle(OrderBase& order) {
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+        order.process(Event::PartiallyFilled{1});
+        order.process(Event::Filled{1});
+    }
+}
+
+namespace crtp_order {
+    using namespace orderfsm;
+
+    class Order: public fsm::Fsm<Order, states> {
+    public:
+        AccountManager &account;
+        int price {};
+        int volume {};
+
+        Order(AccountManager &account, int price, int volume): account(account), price(price), volume(volume) {
+            account.available_USD -= volume * price;
+        }
+
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) {return State::Pending{};}
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) {return State::Placed{};}
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event_partially_filled) {
+            volume -= event_partially_filled.volume;
+            account.available_BTC += event_partially_filled.volume;
+            return State::FilledPartially{};
+        }
+        State::Filled transition(State::FilledPartially&, const Event::Filled& event_filled) {
+            volume = 0;
+            account.available_BTC += event_filled.volume;
+            return State::Filled{};
+        }
+    };
+
+    [[gnu::noinline]] void run_lifecycle(Order& order) {
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+        order.process(Event::PartiallyFilled{1});
+        order.process(Event::Filled{1});
+    }
+
+    [[gnu::noinline]] void run_lifecycle(OrderFSM<OrderType::LIMIT, OrderSide::BUY>& order) {
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+        order.process(Event::PartiallyFilled{1});
+        order.process(Event::Filled{1});
+    }
+}
+
+static void VirtualTransitions(benchmark::State& state) {
+    auto account = orderfsm::AccountManager(0, 0);
+
+    for (auto _ : state) {
+        virtual_order::Order order(account, 10, 2);
+        virtual_order::run_lifecycle(order);
+        benchmark::DoNotOptimize(order);
+    }
+}
+BENCHMARK(VirtualTransitions);
+
+
+static void CRTPTransitions(benchmark::State& state) {
+    auto account = orderfsm::AccountManager(0, 0);
+
+    for (auto _ : state) {
+        crtp_order::Order order(account, 10, 2);
+        crtp_order::run_lifecycle(order);
+        benchmark::DoNotOptimize(order);
+    }
+}
+BENCHMARK(CRTPTransitions);
+
+
+static void OrderFSMLifecycle(benchmark::State& state) {
+    auto account = orderfsm::AccountManager(0, 0);
+
+    for (auto _ : state) {
+        orderfsm::OrderFSM<orderfsm::OrderType::LIMIT, orderfsm::OrderSide::BUY> order(
+                orderfsm::Exchange::CME, orderfsm::Market::BTCUSD, orderfsm::TimeInForce{},
+                orderfsm::Strategy::IcebergPicker, 1, account, 10, 2);
+        crtp_order::run_lifecycle(order);
+        benchmark::DoNotOptimize(order);
+    }
+}
+BENCHMARK(OrderFSMLifecycle);
+
+
+BENCHMARK_MAIN();
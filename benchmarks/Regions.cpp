@@ -0,0 +1,77 @@
+/*
+ * An order tracked together with the risk status of its strategy: the execution reports and risk events of one
+ * order handed to `orderfsm::TrackedOrder`, whose single `process` broadcasts each event to the regions reacting to
+ * it, vs. an order and a risk state machine kept side by side, each event given to both of them.
+ */
+
+#include <array>
+#include <variant>
+
+#include <benchmark/benchmark.h>
+
+#include "OrderFSM.hpp"
+
+
+namespace regions {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+
+    using tracked_events = std::variant<Event::PlaceOrderReqACK, Event::OrderPlacedInOrderBook,
+            Event::PartiallyFilled, Event::Filled, Event::Rejected, RiskEvent::Throttle, RiskEvent::Resume>;
+
+    // the last report is rejected by the filled order, but still throttles the strategy
+    const std::array<tracked_events, 7> reports{
+            Event::PlaceOrderReqACK{}, RiskEvent::Throttle{}, Event::OrderPlacedInOrderBook{}, RiskEvent::Resume{},
+            Event::PartiallyFilled{1}, Event::Filled{1}, Event::Rejected{}};
+
+    // risk events never reach the order and fills never reach the risk region, they are left out at compile time
+    static_assert(!fsm::Regions<Order>::reacts_to<RiskEvent::Throttle>, "the order has no risk transitions");
+    static_assert(!fsm::Regions<RiskFSM>::reacts_to<Event::Filled>, "the risk region has no fill transitions");
+    static_assert(fsm::Regions<OrderRecord>::reacts_to<Event::Filled>,
+                  "a region taking an event only with its context reacts to it");
+}
+
+static void SeparateMachines(benchmark::State& state) {
+    using namespace regions;
+    auto account = AccountManager(0, 0);
+    bool moved = true;
+
+    for (auto _ : state) {
+        Order order(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, 1, account, 10, 2);
+        RiskFSM risk;
+        for (const auto& report : reports) {
+            std::visit([&](const auto& event) {
+                auto order_result = order.process(event);
+                auto risk_result = risk.process(event);
+                benchmark::DoNotOptimize(order_result);
+                benchmark::DoNotOptimize(risk_result);
+            }, report);
+        }
+        moved &= order.is_in<State::Filled>() && risk.is_in<RiskState::Throttled>();
+    }
+    if (!moved)
+        state.SkipWithError("the order or its risk status did not move");
+}
+BENCHMARK(SeparateMachines);
+
+static void TrackedOrderRegions(benchmark::State& state) {
+    using namespace regions;
+    auto account = AccountManager(0, 0);
+    bool moved = true;
+
+    for (auto _ : state) {
+        TrackedOrder tracked(std::forward_as_tuple(Exchange::CME, Market::BTCUSD, TimeInForce{},
+                                                   Strategy::IcebergPicker, 1, account, 10, 2), std::tuple{});
+        for (const auto& report : reports) {
+            auto result = tracked.process(report);
+            benchmark::DoNotOptimize(result);
+        }
+        moved &= tracked.get<Order>().is_in<State::Filled>() && tracked.get<RiskFSM>().is_in<RiskState::Throttled>();
+    }
+    if (!moved)
+        state.SkipWithError("a region of the tracked order did not move");
+}
+BENCHMARK(TrackedOrderRegions);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,74 @@
+/*
+ * Throughput of `fsm::ShardedExecutor`: every benchmark thread is a producer submitting fills for random orders,
+ * with as many pinned workers as producers.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/ShardedExecutor.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace sharded_executor {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+    using Executor = fsm::ShardedExecutor<fsm::MapShard<int, Order>, events>;
+
+    constexpr int ORDERS_PER_WORKER = 10000;
+
+    std::unique_ptr<Executor> executor;
+    // accounting isn't shared between workers
+    std::vector<std::unique_ptr<AccountManager>> accounts;
+
+    // orders are parked in FilledPartially, fills with no volume keep them there
+    void set_up(std::size_t number_workers) {
+        executor = std::make_unique<Executor>(number_workers, number_workers);
+        accounts.clear();
+        for (std::size_t worker = 0; worker < number_workers; worker++)
+            accounts.push_back(std::make_unique<AccountManager>(0, 0));
+
+        for (int order_id = 0; order_id < ORDERS_PER_WORKER * static_cast<int>(number_workers); order_id++) {
+            auto& order = executor->shard_of(order_id).emplace(
+                    order_id, Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, order_id,
+                    *accounts[executor->worker_of(order_id)], 10, 1);
+            order.process(Event::PlaceOrderReqACK{});
+            order.process(Event::OrderPlacedInOrderBook{});
+            order.process(Event::PartiallyFilled{0});
+        }
+        executor->start();
+    }
+
+    int max_threads() {
+        // one core for the producer and one for the worker
+        return std::max(1, static_cast<int>(std::thread::hardware_concurrency() / 2));
+    }
+}
+
+static void ShardedExecutor(benchmark::State& state) {
+    if (state.thread_index() == 0)
+        sharded_executor::set_up(static_cast<std::size_t>(state.threads()));
+
+    auto producer = static_cast<std::size_t>(state.thread_index());
+    std::mt19937 rng(static_cast<unsigned>(producer));
+    std::uniform_int_distribution<int> pick(0, sharded_executor::ORDERS_PER_WORKER * state.threads() - 1);
+
+    for (auto _ : state) {
+        sharded_executor::executor->submit(producer, pick(rng), orderfsm::Event::PartiallyFilled{0});
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+
+    if (state.thread_index() == 0) {
+        sharded_executor::executor->stop();
+        sharded_executor::executor.reset();
+    }
+}
+BENCHMARK(ShardedExecutor)->ThreadRange(1, sharded_executor::max_threads())->UseRealTime();
+
+
+BENCHMARK_MAIN();
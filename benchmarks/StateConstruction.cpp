@@ -0,0 +1,101 @@
+/*
+ * Cost of storing the next state for payloads from 0 to 256 bytes:
+ * transitions returning `std::optional<states>` (the former `process` round trip), returning the next state by value,
+ * and returning `fsm::emplace<State>(args...)` / a reference to the mutated current state.
+ */
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <variant>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/FSM.hpp>
+
+
+namespace state_construction {
+    template<std::size_t N>
+    struct Payload {
+        std::array<std::uint8_t, N> bytes{};
+
+        Payload() = default;
+        explicit Payload(std::uint8_t value) { bytes.fill(value); }
+    };
+
+    template<std::size_t N>
+    struct Quoting: Payload<N> { using Payload<N>::Payload; };
+    template<std::size_t N>
+    struct Trading: Payload<N> { using Payload<N>::Payload; };
+
+    template<std::size_t N>
+    using states = std::variant<Quoting<N>, Trading<N>>;
+
+    struct Toggle {std::uint8_t value{};};
+    struct Amend {std::uint8_t value{};};
+
+    template<std::size_t N>
+    struct OptionalRoundTrip: fsm::Fsm<OptionalRoundTrip<N>, states<N>> {
+        std::optional<states<N>> transition(Quoting<N>&, const Toggle& event) {return Trading<N>(event.value);}
+        std::optional<states<N>> transition(Trading<N>&, const Toggle& event) {return Quoting<N>(event.value);}
+        std::optional<states<N>> transition(Trading<N>&, const Amend& event) {return Trading<N>(event.value);}
+    };
+
+    template<std::size_t N>
+    struct ByValue: fsm::Fsm<ByValue<N>, states<N>> {
+        Trading<N> transition(Quoting<N>&, const Toggle& event) {return Trading<N>(event.value);}
+        Quoting<N> transition(Trading<N>&, const Toggle& event) {return Quoting<N>(event.value);}
+        Trading<N> transition(Trading<N>&, const Amend& event) {return Trading<N>(event.value);}
+    };
+
+    template<std::size_t N>
+    struct InPlace: fsm::Fsm<InPlace<N>, states<N>> {
+        auto transition(Quoting<N>&, const Toggle& event) {return fsm::emplace<Trading<N>>(event.value);}
+        auto transition(Trading<N>&, const Toggle& event) {return fsm::emplace<Quoting<N>>(event.value);}
+        Trading<N>& transition(Trading<N>& state, const Amend& event) {
+            state.bytes.fill(event.value);
+            return state;
+        }
+    };
+
+    // Quoting -> Trading -> Trading -> Quoting
+    template<typename TMachine>
+    void run(benchmark::State& state) {
+        TMachine machine;
+        std::uint8_t value = 0;
+
+        for (auto _ : state) {
+            machine.process(Toggle{value++});
+            machine.process(Amend{value++});
+            machine.process(Toggle{value++});
+            benchmark::DoNotOptimize(machine);
+        }
+    }
+}
+
+template<std::size_t N>
+static void OptionalRoundTrip(benchmark::State& state) {state_construction::run<state_construction::OptionalRoundTrip<N>>(state);}
+BENCHMARK_TEMPLATE(OptionalRoundTrip, 0);
+BENCHMARK_TEMPLATE(OptionalRoundTrip, 8);
+BENCHMARK_TEMPLATE(OptionalRoundTrip, 64);
+BENCHMARK_TEMPLATE(OptionalRoundTrip, 128);
+BENCHMARK_TEMPLATE(OptionalRoundTrip, 256);
+
+template<std::size_t N>
+static void ByValue(benchmark::State& state) {state_construction::run<state_construction::ByValue<N>>(state);}
+BENCHMARK_TEMPLATE(ByValue, 0);
+BENCHMARK_TEMPLATE(ByValue, 8);
+BENCHMARK_TEMPLATE(ByValue, 64);
+BENCHMARK_TEMPLATE(ByValue, 128);
+BENCHMARK_TEMPLATE(ByValue, 256);
+
+template<std::size_t N>
+static void InPlace(benchmark::State& state) {state_construction::run<state_construction::InPlace<N>>(state);}
+BENCHMARK_TEMPLATE(InPlace, 0);
+BENCHMARK_TEMPLATE(InPlace, 8);
+BENCHMARK_TEMPLATE(InPlace, 64);
+BENCHMARK_TEMPLATE(InPlace, 128);
+BENCHMARK_TEMPLATE(InPlace, 256);
+
+
+BENCHMARK_MAIN();
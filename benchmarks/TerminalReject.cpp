@@ -0,0 +1,66 @@
+/*
+ * Late execution reports for an order that is already filled. Without declared events every report goes through
+ * dispatch and overload resolution before being rejected; with `using events` the filled state is known to be
+ * terminal at compile time and the report is rejected after a single test of the state index.
+ */
+
+#include <array>
+
+#include <benchmark/benchmark.h>
+
+#include "OrderFSM.hpp"
+
+
+namespace terminal_reject {
+    using namespace orderfsm;
+
+    template<typename TOrder>
+    struct Transitions {
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) { return {}; }
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) { return {}; }
+        State::Filled transition(State::Placed&, const Event::Filled&) { return {}; }
+        State::PendingCancel transition(State::Placed&, const Event::PendingCancellationACK&) { return {}; }
+        State::Cancelled transition(State::PendingCancel&, const Event::Cancelled&) { return {}; }
+    };
+
+    class UndeclaredOrder: public fsm::Fsm<UndeclaredOrder, states>, public Transitions<UndeclaredOrder> {
+    public:
+        using Transitions::transition;
+    };
+
+    class DeclaredOrder: public fsm::Fsm<DeclaredOrder, states>, public Transitions<DeclaredOrder> {
+    public:
+        using events = orderfsm::events;
+        using Transitions::transition;
+    };
+
+    const std::array<events, 4> late_reports{
+        Event::PartiallyFilled{1}, Event::Filled{}, Event::Cancelled{}, Event::PendingCancellationACK{}};
+
+    template<typename TOrder>
+    TOrder filled_order() {
+        TOrder order;
+        order.process(Event::PlaceOrderReqACK{});
+        order.process(Event::OrderPlacedInOrderBook{});
+        order.process(Event::Filled{});
+        return order;
+    }
+}
+
+template<typename TOrder>
+static void RejectLateReports(benchmark::State& state) {
+    auto order = terminal_reject::filled_order<TOrder>();
+    for (auto _ : state) {
+        for (const auto& report : terminal_reject::late_reports) {
+            auto result = order.process(report);
+            benchmark::DoNotOptimize(result);
+        }
+        auto result = order.process(orderfsm::Event::Cancelled{});
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(RejectLateReports<terminal_reject::UndeclaredOrder>);
+BENCHMARK(RejectLateReports<terminal_reject::DeclaredOrder>);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,104 @@
+/*
+ * `fsm::TimerWheel` with a million armed timers: arming and cancelling one more timer, and expiring all of them.
+ * Expiring good till date orders through their state timers, with the orders moved after their timers were armed.
+ */
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/TimerWheel.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace timer_wheel {
+    using Wheel = fsm::TimerWheel<std::uint32_t>;
+
+    constexpr std::uint32_t NUMBER_TIMERS = 1'000'000;
+    // deadlines spread over a day in milliseconds
+    constexpr std::uint64_t HORIZON = 24 * 60 * 60 * 1000;
+
+    std::vector<std::uint64_t> get_deadlines() {
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<std::uint64_t> pick(1, HORIZON);
+        std::vector<std::uint64_t> deadlines(NUMBER_TIMERS);
+        for (auto& deadline : deadlines)
+            deadline = pick(rng);
+        return deadlines;
+    }
+
+    void arm_all(Wheel& wheel, const std::vector<std::uint64_t>& deadlines) {
+        wheel.reserve(deadlines.size() + 1);
+        for (std::uint32_t i = 0; i < deadlines.size(); i++)
+            wheel.arm(deadlines[i], i);
+    }
+}
+
+static void ArmCancel(benchmark::State& state) {
+    const auto deadlines = timer_wheel::get_deadlines();
+    timer_wheel::Wheel wheel;
+    timer_wheel::arm_all(wheel, deadlines);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        auto id = wheel.arm(deadlines[i++ % deadlines.size()], 0);
+        auto cancelled = wheel.cancel(id);
+        benchmark::DoNotOptimize(cancelled);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(ArmCancel);
+
+static void ExpireAll(benchmark::State& state) {
+    const auto deadlines = timer_wheel::get_deadlines();
+    std::size_t fired = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        timer_wheel::Wheel wheel;
+        timer_wheel::arm_all(wheel, deadlines);
+        state.ResumeTiming();
+        // one advance per second of the day
+        for (std::uint64_t now = 1000; now <= timer_wheel::HORIZON; now += 1000)
+            fired += wheel.advance(now, [](std::uint32_t id) { benchmark::DoNotOptimize(id); });
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(fired));
+}
+BENCHMARK(ExpireAll)->Unit(benchmark::kMillisecond);
+
+// The orders are acknowledged while the vector holding them grows, so most of them are moved with their timer
+// armed; every order has to be expired at its new address.
+static void ExpireOrders(benchmark::State& state) {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+    constexpr std::uint32_t NUMBER_ORDERS = 100'000;
+    const auto deadlines = timer_wheel::get_deadlines();
+    auto account = AccountManager(0, 0);
+    std::size_t expired = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Order::ExpiryWheel wheel;
+        std::vector<Order> orders;
+        for (std::uint32_t i = 0; i < NUMBER_ORDERS; i++) {
+            auto& order = orders.emplace_back(Exchange::CME, Market::BTCUSD,
+                                              TimeInForce{false, false, false, true, deadlines[i]},
+                                              Strategy::IcebergPicker, static_cast<int>(i), account, 10, 1);
+            order.attach(wheel);
+            order.process(Event::PlaceOrderReqACK{});
+        }
+        state.ResumeTiming();
+        expired += wheel.advance(timer_wheel::HORIZON, Order::expire);
+        state.PauseTiming();
+        for (const auto& order : orders) {
+            if (!order.is_in<State::Expired>())
+                state.SkipWithError("an order was not expired");
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(expired));
+}
+BENCHMARK(ExpireOrders)->Unit(benchmark::kMillisecond);
+
+
+BENCHMARK_MAIN();
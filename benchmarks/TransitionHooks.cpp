@@ -0,0 +1,84 @@
+/*
+ * Entry/exit/transition hooks: a machine without hooks, the same machine with empty hooks (both should compile to the
+ * same code) and with hooks doing some bookkeeping. Every machine is driven through its own out of line `process_*`
+ * function, so the code generated for each can be compared in the output of
+ *   objdump -d -C --no-addresses --no-show-raw-insn benchmark_TransitionHooks
+ * `process_no_hooks` and `process_empty_hooks` only differ in their names.
+ */
+
+#include <variant>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/FSM.hpp>
+
+
+namespace transition_hooks {
+    struct Idle {int since{};};
+    struct Working {int since{};};
+    struct Done {int since{};};
+    using states = std::variant<Idle, Working, Done>;
+
+    struct Tick {int now{};};
+
+    template<typename TChild>
+    struct Transitions: fsm::Fsm<TChild, states> {
+        Working transition(Idle&, const Tick& event) {return Working{event.now};}
+        Done transition(Working&, const Tick& event) {return Done{event.now};}
+        Idle transition(Done&, const Tick& event) {return Idle{event.now};}
+    };
+
+    struct NoHooks: Transitions<NoHooks> {};
+
+    struct EmptyHooks: Transitions<EmptyHooks> {
+        template<typename TState>
+        void on_entry(TState&) {}
+        template<typename TState>
+        void on_exit(TState&) {}
+        template<typename TFrom, typename TEvent, typename TTo>
+        void on_transition(TFrom&, TEvent&, TTo&) {}
+    };
+
+    struct BookkeepingHooks: Transitions<BookkeepingHooks> {
+        int entries{};
+        int exits{};
+        int time_in_states{};
+
+        template<typename TState>
+        void on_entry(TState&) {++entries;}
+        template<typename TState>
+        void on_exit(TState&) {++exits;}
+        template<typename TFrom, typename TEvent, typename TTo>
+        void on_transition(TFrom& from, TEvent&, TTo& to) {time_in_states += to.since - from.since;}
+    };
+
+    // kept out of line and out of interprocedural optimizations, so each shows up once in the disassembly
+    [[gnu::noipa]] void process_no_hooks(NoHooks& machine, Tick tick) {machine.process(tick);}
+    [[gnu::noipa]] void process_empty_hooks(EmptyHooks& machine, Tick tick) {machine.process(tick);}
+    [[gnu::noipa]] void process_bookkeeping_hooks(BookkeepingHooks& machine, Tick tick) {machine.process(tick);}
+
+    template<typename TMachine>
+    void run(benchmark::State& state, void (*process)(TMachine&, Tick)) {
+        TMachine machine;
+        int now = 0;
+
+        for (auto _ : state) {
+            process(machine, Tick{now++});
+            benchmark::DoNotOptimize(machine);
+        }
+    }
+}
+
+static void NoHooks(benchmark::State& state) {transition_hooks::run(state, transition_hooks::process_no_hooks);}
+BENCHMARK(NoHooks);
+
+static void EmptyHooks(benchmark::State& state) {transition_hooks::run(state, transition_hooks::process_empty_hooks);}
+BENCHMARK(EmptyHooks);
+
+static void BookkeepingHooks(benchmark::State& state) {
+    transition_hooks::run(state, transition_hooks::process_bookkeeping_hooks);
+}
+BENCHMARK(BookkeepingHooks);
+
+
+BENCHMARK_MAIN();
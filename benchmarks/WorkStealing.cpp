@@ -0,0 +1,129 @@
+/*
+ * Skewed load: fills for order ids drawn from a Zipf distribution, so a few hot orders get most of the events.
+ * Static sharding by order id (`fsm::ShardedExecutor`) vs. `fsm::WorkStealingScheduler`, where idle workers steal
+ * whole orders from busy ones. Every event also runs a small fixed amount of work, standing in for risk checks.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fsm/ShardedExecutor.hpp>
+#include <fsm/WorkStealingScheduler.hpp>
+#include "OrderFSM.hpp"
+
+
+namespace work_stealing {
+    using namespace orderfsm;
+    using Order = OrderFSM<OrderType::LIMIT, OrderSide::BUY>;
+
+    constexpr int NUMBER_ORDERS = 10000;
+    constexpr std::size_t NUMBER_EVENTS = 1 << 16;
+    constexpr double ZIPF_EXPONENT = 1.1;
+    constexpr int WORK_PER_EVENT = 200;
+
+    // an order parked in FilledPartially with its own account, so it can be processed by any worker
+    struct WorkingOrder {
+        AccountManager account{0, 0};
+        Order order;
+
+        explicit WorkingOrder(int order_id)
+        : order(Exchange::CME, Market::BTCUSD, TimeInForce{}, Strategy::IcebergPicker, order_id, account, 10, 1) {
+            order.process(Event::PlaceOrderReqACK{});
+            order.process(Event::OrderPlacedInOrderBook{});
+            order.process(Event::PartiallyFilled{0});
+        }
+
+        fsm::Result process(const events& event) {
+            for (int i = 0; i < WORK_PER_EVENT; i++)
+                benchmark::DoNotOptimize(i);
+            return order.process(event);
+        }
+    };
+
+    // counts processed events, only written by the worker owning the shard
+    struct CountingShard: fsm::MapShard<int, WorkingOrder> {
+        alignas(64) std::atomic<std::size_t> processed{};
+
+        fsm::Result process(const int& key, const events& event) {
+            processed.store(processed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return MapShard::process(key, event);
+        }
+    };
+
+    using Executor = fsm::ShardedExecutor<CountingShard, events>;
+    using Scheduler = fsm::WorkStealingScheduler<WorkingOrder, events>;
+
+    std::vector<int> get_order_ids() {
+        std::vector<double> cdf(NUMBER_ORDERS);
+        double sum = 0;
+        for (int rank = 0; rank < NUMBER_ORDERS; rank++)
+            cdf[rank] = sum += 1 / std::pow(rank + 1, ZIPF_EXPONENT);
+
+        // hot orders are spread over the id space, not all on the first worker
+        std::vector<int> ids(NUMBER_ORDERS);
+        for (int i = 0; i < NUMBER_ORDERS; i++)
+            ids[i] = i;
+        std::mt19937 rng(42);
+        std::shuffle(ids.begin(), ids.end(), rng);
+
+        std::uniform_real_distribution<double> pick(0, sum);
+        std::vector<int> order_ids(NUMBER_EVENTS);
+        for (auto& order_id : order_ids)
+            order_id = ids[std::lower_bound(cdf.begin(), cdf.end(), pick(rng)) - cdf.begin()];
+        return order_ids;
+    }
+
+    const std::vector<int> order_ids = get_order_ids();
+}
+
+static void StaticSharding(benchmark::State& state) {
+    using namespace work_stealing;
+    const auto number_workers = static_cast<std::size_t>(state.range(0));
+    Executor executor(number_workers, 1);
+    for (int order_id = 0; order_id < NUMBER_ORDERS; order_id++)
+        executor.shard_of(order_id).emplace(order_id, order_id);
+    executor.start();
+
+    std::size_t submitted = 0;
+    for (auto _ : state) {
+        for (auto order_id : order_ids)
+            executor.submit(0, order_id, orderfsm::Event::PartiallyFilled{0});
+        submitted += order_ids.size();
+        // wait for the slowest worker
+        for (std::size_t processed = 0; processed != submitted;) {
+            processed = 0;
+            for (std::size_t worker = 0; worker < number_workers; worker++)
+                processed += executor.shard(worker).processed.load(std::memory_order_acquire);
+            std::this_thread::yield();
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(submitted));
+}
+BENCHMARK(StaticSharding)->Arg(2)->Arg(4)->UseRealTime();
+
+static void WorkStealing(benchmark::State& state) {
+    using namespace work_stealing;
+    Scheduler scheduler(static_cast<std::size_t>(state.range(0)));
+    for (int order_id = 0; order_id < NUMBER_ORDERS; order_id++)
+        scheduler.emplace(order_id);
+    scheduler.start();
+
+    for (auto _ : state) {
+        for (auto order_id : order_ids)
+            scheduler.submit(static_cast<Scheduler::Handle>(order_id), orderfsm::Event::PartiallyFilled{0});
+        while (!scheduler.idle())
+            std::this_thread::yield();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * order_ids.size()));
+}
+BENCHMARK(WorkStealing)->Arg(2)->Arg(4)->UseRealTime();
+
+
+BENCHMARK_MAIN();
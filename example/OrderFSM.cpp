@@ -13,17 +13,35 @@ int main() {
             1,
             account_manager,
             10,
-            1
+            100
             );
 
     order.process(orderfsm::Event::PlaceOrderReqACK {});
     order.process(orderfsm::Event::OrderPlacedInOrderBook {});
     order.process(orderfsm::Event::PartiallyFilled {10});
+    // no volume is left, the order raises Event::Filled itself and is filled when `process` returns
     order.process(orderfsm::Event::PartiallyFilled {90});
-    // from execution report we see that volume left for this order is 0 and generate event filled with volume 0
-    // the same event can be used to fill the whole order
-    order.process(orderfsm::Event::Filled{0});
 
-    // this will throw an exception since the transition is not allowed
-    order.process(orderfsm::Event::Filled{0});
+    // the transition is not allowed, the event is rejected without throwing
+    if (order.process(orderfsm::Event::Filled{0}) == fsm::Result::Rejected)
+        std::cout << "Transition not allowed" << std::endl;
+
+    // a good till date order attached to an expiry wheel is expired by the wheel once its deadline has passed
+    using Order = orderfsm::OrderFSM<orderfsm::OrderType::LIMIT, orderfsm::OrderSide::BUY>;
+    auto expiry_wheel = Order::ExpiryWheel{};
+    auto good_till_date = Order(
+            orderfsm::Exchange::Deribit,
+            orderfsm::Market::BTCUSD,
+            orderfsm::TimeInForce{false, false, false, true, 100},
+            orderfsm::Strategy::RabateEater,
+            2,
+            account_manager,
+            10,
+            100
+            );
+    good_till_date.attach(expiry_wheel);
+    good_till_date.process(orderfsm::Event::PlaceOrderReqACK {});
+    expiry_wheel.advance(100, Order::expire);
+    if (good_till_date.is_in<orderfsm::State::Expired>())
+        std::cout << "Good till date order expired" << std::endl;
 }
\ No newline at end of file
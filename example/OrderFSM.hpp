@@ -1,8 +1,12 @@
 #ifndef EXAMPLE_ORDERFSM_HPP
 #define EXAMPLE_ORDERFSM_HPP
+#include <cstdint>
 #include <iostream>
+#include <optional>
 
 #include <fsm/FSM.hpp>
+#include <fsm/Regions.hpp>
+#include <fsm/TimerWheel.hpp>
 
 
 namespace orderfsm {
@@ -38,6 +42,7 @@ namespace orderfsm {
         const bool immediate_or_kill{};
         const bool good_till_cancel{};
         const bool good_till_date{};
+        const std::uint64_t expire_at{};    // deadline of good till date orders, in ticks of the expiry wheel
     };
 
     struct State {
@@ -51,6 +56,10 @@ namespace orderfsm {
         struct FilledPartially {}; // part of the order matched, producing a trade, some order volume left in the order book
         struct Expired {};  // order removed from the order book because it's life expectancy came to an end
         struct Rejected {}; // order was rejected
+
+        // superstates, handling events on behalf of their members
+        struct LiveInBook: fsm::Superstate<Placed, FilledPartially, PendingModification> {};   // resting in the order book
+        struct Open: fsm::Superstate<Pending, PendingCancel, LiveInBook> {};    // not in an end state yet
     };
 
     // we generate events from parsed execution report
@@ -85,6 +94,27 @@ namespace orderfsm {
             State::Rejected
     >;
 
+    // runtime representation of a decoded execution report
+    using events = std::variant<
+            Event::PlaceOrderReqACK,
+            Event::PendingCancellationACK,
+            Event::PendingModificationACK,
+            Event::OrderPlacedInOrderBook,
+            Event::ModifiedPlaced,
+            Event::PartiallyFilled,
+            Event::ModifiedPartiallyFilled,
+            Event::Filled,
+            Event::Rejected,
+            Event::Cancelled,
+            Event::Expired
+    >;
+
+    // fills racing a modification request are kept until the exchange acknowledges the modification
+    using deferred = fsm::deferral::Queue<4, Event::PartiallyFilled, Event::Filled>;
+
+    // fills that leave no open volume raise `Filled` from within the state machine
+    using posted = fsm::posting::Queue<1, Event::Filled>;
+
     class AccountManager {
     public:
         int available_BTC{};
@@ -95,8 +125,17 @@ namespace orderfsm {
     };
 
     template<OrderType TOrderType, OrderSide TOrderSide>
-    class OrderFSMBase: public fsm::Fsm<OrderFSMBase<TOrderType, TOrderSide>, states> {
+    class OrderFSM;
+
+    // Data shared by all order types. The `OrderFSM` specialization for a type/side is the CRTP child providing the
+    // transitions, so they are resolved statically and the order carries no vtable pointer.
+    template<OrderType TOrderType, OrderSide TOrderSide>
+    class OrderFSMBase: public fsm::Fsm<OrderFSM<TOrderType, TOrderSide>, states, fsm::dispatch::Visit,
+                                        fsm::policy::Ignore, deferred, posted> {
     public:
+        // lets `fsm::Fsm` find the terminal states: filled, cancelled, expired and rejected orders handle none of them
+        using events = orderfsm::events;
+
         const Exchange exchange_id{};
         const Market market_id{};
         const TimeInForce time_in_force{};
@@ -123,189 +162,264 @@ namespace orderfsm {
             price(price),
             volume(volume) {}
 
-        template<typename TState, typename TEvent>
-        std::optional<states> transition(TState&, const TEvent&) { throw std::logic_error("Transition not allowed"); }
-        virtual State::Rejected transition(State::Sent&, const Event::Rejected&) = 0;
-        virtual State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) = 0;
-        virtual State::PendingCancel transition(State::Pending&, const Event::PendingCancellationACK&) = 0;
-        virtual State::PendingCancel transition(State::Placed&, const Event::PendingCancellationACK&) = 0;
-        virtual State::PendingCancel transition(State::FilledPartially&, const Event::PendingCancellationACK&) = 0;
-        virtual State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) = 0;
-        virtual State::Placed transition(State::PendingModification&, const Event::ModifiedPlaced& event_modified_placed) = 0;
-        virtual State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event_partially_filled) = 0;
-        virtual State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event_partially_filled) = 0;
-        virtual State::FilledPartially transition(State::PendingModification&, const Event::ModifiedPartiallyFilled& event_modify_partially_filled) = 0;
-        virtual State::Filled transition(State::Placed&, const Event::Filled& event_filled) = 0;
-        virtual State::Filled transition(State::FilledPartially&, const Event::Filled& event_filled) = 0;
-        virtual State::Cancelled transition(State::PendingCancel&, const Event::Cancelled&) = 0;
-        virtual State::Cancelled transition(State::Placed&, const Event::Cancelled&) = 0;
-        virtual State::Cancelled transition(State::FilledPartially&, const Event::Cancelled&) = 0;
-        virtual State::PendingModification transition(State::Placed&, const Event::PendingModificationACK &) = 0;
-        virtual State::PendingModification transition(State::FilledPartially&, const Event::PendingModificationACK &) = 0;
-        virtual State::Expired transition(State::PendingCancel&, const Event::Expired&) = 0;
-        virtual State::Expired transition(State::Placed&, const Event::Expired&) = 0;
-        virtual State::Expired transition(State::FilledPartially&, const Event::Expired&) = 0;
-        virtual State::Expired transition(State::Pending&, const Event::Expired&) = 0;
-        virtual State::Expired transition(State::PendingModification&, const Event::Expired&) = 0;
+        // state/event pairs without a `transition` overload in the child are rejected by `fsm::Fsm`
     };
 
     template<OrderType TOrderType, OrderSide TOrderSide>
     class OrderFSM : public OrderFSMBase<TOrderType, TOrderSide> {};
 
-    template<>
-    class OrderFSM<OrderType::LIMIT, OrderSide::BUY> : public OrderFSMBase<OrderType::LIMIT, OrderSide::BUY> {
+    // The transitions of a limit buy order, written once for `OrderFSM<LIMIT, BUY>` and `OrderRecord`, so the record
+    // behaves like the order it stands in for. `TBase` is the `fsm::Fsm` base holding the order's price, volume and
+    // time in force. Every transition takes the account it books against last: the order passes the one it stores,
+    // the record gets it as the context of `process(event, account)`.
+    template<typename TBase>
+    class LimitBuyTransitions: public TBase {
     public:
-        OrderFSM(const Exchange exchange_id,
-                 const Market market_id,
-                 const TimeInForce time_in_force,
-                 const Strategy strategy_id,
-                 const int order_id,
-                 AccountManager &account,
-                 int price,
-                 int volume
-        ) : OrderFSMBase<OrderType::LIMIT, OrderSide::BUY>(exchange_id,
-                         market_id,
-                         time_in_force,
-                         strategy_id,
-                         order_id,
-                         account,
-                         price,
-                         volume) {
-            account.available_USD -= volume * price;
-        };
+        using superstates = std::tuple<State::LiveInBook, State::Open>;
+
+        using TBase::TBase;
 
         // transitions to rejected state
-        State::Rejected transition(State::Sent&, const Event::Rejected&) final {
-            account.available_USD += volume * price;
+        State::Rejected transition(State::Sent&, const Event::Rejected&, AccountManager& account) {
+            account.available_USD += this->volume * this->price;
             return State::Rejected{};
         }
 
         // transitions to pending state
-        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&) final {return State::Pending{};}
+        State::Pending transition(State::Sent&, const Event::PlaceOrderReqACK&, AccountManager&) {
+            return State::Pending{};}
 
         // transitions to pending_cancellation state
-        State::PendingCancel transition(State::Pending&, const Event::PendingCancellationACK&) final {
+        State::PendingCancel transition(State::Pending&, const Event::PendingCancellationACK&, AccountManager&) {
             return State::PendingCancel{};}
-        State::PendingCancel transition(State::Placed&, const Event::PendingCancellationACK&) final {
+        State::PendingCancel transition(State::Placed&, const Event::PendingCancellationACK&, AccountManager&) {
             return State::PendingCancel{};}
-        State::PendingCancel transition(State::FilledPartially&, const Event::PendingCancellationACK&) final {
+        State::PendingCancel transition(State::FilledPartially&, const Event::PendingCancellationACK&,
+                                        AccountManager&) {
             return State::PendingCancel{};}
 
         // transitions to placed state
-        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&) final {
+        State::Placed transition(State::Pending&, const Event::OrderPlacedInOrderBook&, AccountManager&) {
             return State::Placed{};}
-        State::Placed transition(State::PendingModification&, const Event::ModifiedPlaced& event_modified_placed) final {
-            account.available_USD += (price * volume)
+        State::Placed transition(State::PendingModification&, const Event::ModifiedPlaced& event_modified_placed,
+                                 AccountManager& account) {
+            account.available_USD += (this->price * this->volume)
                     - (event_modified_placed.price_new * event_modified_placed.volume_new);
-            price = event_modified_placed.price_new;
-            volume = event_modified_placed.volume_new;
+            this->price = event_modified_placed.price_new;
+            this->volume = event_modified_placed.volume_new;
             return State::Placed{};}
 
         // transitions to partially filled state
-        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event_partially_filled) final {
-            volume -= event_partially_filled.volume;
-            account.available_BTC += event_partially_filled.volume;
-            return State::FilledPartially{};
+        // when no volume is left, Event::Filled is raised and processed before `process` returns
+        State::FilledPartially transition(State::Placed&, const Event::PartiallyFilled& event_partially_filled,
+                                          AccountManager& account) {
+            return fill(event_partially_filled, account);
         }
-        // when volume_left = 0 in execution report, we'll trigger Event::Filled
-        State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event_partially_filled) final {
-            volume -= event_partially_filled.volume;
-            account.available_BTC += event_partially_filled.volume;
-            return State::FilledPartially{};
+        State::FilledPartially transition(State::FilledPartially&, const Event::PartiallyFilled& event_partially_filled,
+                                          AccountManager& account) {
+            return fill(event_partially_filled, account);
         }
-        State::FilledPartially transition(State::PendingModification&, const Event::ModifiedPartiallyFilled& event_modify_partially_filled) final {
-            account.available_USD += (price * volume)
-                                     - (event_modify_partially_filled.price_new * event_modify_partially_filled.volume_new);
-            price = event_modify_partially_filled.price_new;
-            volume = event_modify_partially_filled.volume_new;
+        State::FilledPartially transition(State::PendingModification&,
+                                          const Event::ModifiedPartiallyFilled& event_modify_partially_filled,
+                                          AccountManager& account) {
+            account.available_USD += (this->price * this->volume)
+                    - (event_modify_partially_filled.price_new * event_modify_partially_filled.volume_new);
+            this->price = event_modify_partially_filled.price_new;
+            this->volume = event_modify_partially_filled.volume_new;
             return State::FilledPartially{};
         }
 
+        // fills may overtake the ack of a modification, they are applied once the modification is acknowledged
+        fsm::Defer transition(State::PendingModification&, const Event::PartiallyFilled&, AccountManager&) {
+            return {};}
+        fsm::Defer transition(State::PendingModification&, const Event::Filled&, AccountManager&) { return {}; }
+
         // transitions to filled state
-        // when volume_left = 0 in execution report, we'll trigger Event::Filled
-        State::Filled transition(State::Placed&, const Event::Filled& event_filled) final {
-            volume = 0;
-            account.available_BTC += event_filled.volume;
-            return State::Filled{};
+        // raised by a partial fill leaving no volume, or received directly when the whole order is filled at once
+        State::Filled transition(State::Placed&, const Event::Filled& event_filled, AccountManager& account) {
+            return fill_all(event_filled, account);
         }
-        // when volume_left = 0 in execution report, we'll trigger Event::Filled
-        State::Filled transition(State::FilledPartially&, const Event::Filled& event_filled) final {
-            volume = 0;
-            account.available_BTC += event_filled.volume;
-            return State::Filled{};
+        State::Filled transition(State::FilledPartially&, const Event::Filled& event_filled, AccountManager& account) {
+            return fill_all(event_filled, account);
         }
 
         // transitions to cancelled state
-        State::Cancelled transition(State::PendingCancel&, const Event::Cancelled&) final {
-            account.available_USD += price * volume;
+        State::Cancelled transition(State::PendingCancel&, const Event::Cancelled&, AccountManager& account) {
+            account.available_USD += this->price * this->volume;
             return State::Cancelled{};
         }
-        State::Cancelled transition(State::Placed&, const Event::Cancelled&) final {
-            if (time_in_force.immediate_or_kill) {
-                account.available_USD += price * volume;
+        fsm::OneOf<State::Cancelled, fsm::Stay> transition(State::Placed&, const Event::Cancelled&,
+                                                           AccountManager& account) {
+            if (this->time_in_force.immediate_or_kill) {
+                account.available_USD += this->price * this->volume;
             } else {
-                throw std::logic_error("Transition not allowed");
+                return fsm::Stay{};    // guard failed, the order stays where it is
             };
             return State::Cancelled{};
         }
-        State::Cancelled transition(State::FilledPartially&, const Event::Cancelled&) final {
-            if (time_in_force.immediate_or_cancel) {
-                account.available_USD += price * volume;
+        fsm::OneOf<State::Cancelled, fsm::Stay> transition(State::FilledPartially&, const Event::Cancelled&,
+                                                           AccountManager& account) {
+            if (this->time_in_force.immediate_or_cancel) {
+                account.available_USD += this->price * this->volume;
             } else {
-                throw std::logic_error("Transition not allowed");
+                return fsm::Stay{};    // guard failed, the order stays where it is
             };
             return State::Cancelled{};
         }
 
         // transition to pending_modification state
-        State::PendingModification transition(State::Placed&, const Event::PendingModificationACK &) final {
+        State::PendingModification transition(State::Placed&, const Event::PendingModificationACK&, AccountManager&) {
             return State::PendingModification{};
         }
-        State::PendingModification transition(State::FilledPartially&, const Event::PendingModificationACK &) final {
+        State::PendingModification transition(State::FilledPartially&, const Event::PendingModificationACK&,
+                                              AccountManager&) {
             return State::PendingModification{};
         }
 
-        // transition to expired state
-        State::Expired transition(State::PendingCancel&, const Event::Expired&) final {
-            if (time_in_force.good_till_date) {
-                account.available_USD += price * volume;
+        // transition to expired state, the same for every open order
+        fsm::OneOf<State::Expired, fsm::Stay> transition(State::Open&, const Event::Expired&, AccountManager& account) {
+            if (this->time_in_force.good_till_date) {
+                account.available_USD += this->price * this->volume;
             } else {
-                throw std::logic_error("Transition not allowed");
+                return fsm::Stay{};    // guard failed, the order stays where it is
             };
             return State::Expired{};
         }
-        State::Expired transition(State::Placed&, const Event::Expired&) final {
-            if (time_in_force.good_till_date) {
-                account.available_USD += price * volume;
-            } else {
-                throw std::logic_error("Transition not allowed");
-            };
-            return State::Expired{};
+    private:
+        State::FilledPartially fill(const Event::PartiallyFilled& event_partially_filled, AccountManager& account) {
+            this->volume -= event_partially_filled.volume;
+            account.available_BTC += event_partially_filled.volume;
+            if (this->volume == 0)
+                this->post(Event::Filled{0});
+            return State::FilledPartially{};
         }
-        State::Expired transition(State::FilledPartially&, const Event::Expired&) final {
-            if (time_in_force.good_till_date) {
-                account.available_USD += price * volume;
-            } else {
-                throw std::logic_error("Transition not allowed");
-            };
-            return State::Expired{};
+        State::Filled fill_all(const Event::Filled& event_filled, AccountManager& account) {
+            this->volume = 0;
+            account.available_BTC += event_filled.volume;
+            return State::Filled{};
         }
-        State::Expired transition(State::Pending&, const Event::Expired&) final {
-            if (time_in_force.good_till_date) {
-                account.available_USD += price * volume;
-            } else {
-                throw std::logic_error("Transition not allowed");
-            };
-            return State::Expired{};
+    };
+
+    template<>
+    class OrderFSM<OrderType::LIMIT, OrderSide::BUY>
+            : public LimitBuyTransitions<OrderFSMBase<OrderType::LIMIT, OrderSide::BUY>> {
+        using Transitions = LimitBuyTransitions<OrderFSMBase<OrderType::LIMIT, OrderSide::BUY>>;
+    public:
+        using ExpiryWheel = fsm::TimerWheel<OrderFSM*>;
+
+        // Good till date orders are expired through an `ExpiryWheel` once attached to one: the timer is armed when
+        // the order becomes open and cancelled when it is filled, cancelled or expired. Pass `expire` as the
+        // callback of `ExpiryWheel::advance` to feed `Event::Expired` to the due orders.
+        fsm::StateTimer<ExpiryWheel> expiry;
+        fsm::StateTimer<ExpiryWheel>& state_timer() { return expiry; }
+        // before the order is acknowledged, so its timer is armed when it becomes open
+        void attach(ExpiryWheel& wheel) { expiry.attach(wheel, this); }
+        static void expire(OrderFSM* order) { order->process(Event::Expired{}); }
+        std::optional<std::uint64_t> timeout(const State::Open&) const {
+            if (!time_in_force.good_till_date)
+                return std::nullopt;
+            return time_in_force.expire_at;
         }
-        State::Expired transition(State::PendingModification&, const Event::Expired&) final {
-            if (time_in_force.good_till_date) {
-                account.available_USD += price * volume;
-            } else {
-                throw std::logic_error("Transition not allowed");
-            };
-            return State::Expired{};
+
+        OrderFSM(const Exchange exchange_id,
+                 const Market market_id,
+                 const TimeInForce time_in_force,
+                 const Strategy strategy_id,
+                 const int order_id,
+                 AccountManager &account,
+                 int price,
+                 int volume
+        ) : Transitions(exchange_id,
+                        market_id,
+                        time_in_force,
+                        strategy_id,
+                        order_id,
+                        account,
+                        price,
+                        volume) {
+            account.available_USD -= volume * price;
+        };
+
+        // the expiry timer fires with the order's address, so it follows the order to its new one
+        OrderFSM(OrderFSM&& other) noexcept: Transitions(std::move(other)), expiry(std::move(other.expiry)) {
+            expiry.rebind(this);
+        }
+
+        // the shared transitions, booked against the account the order stores
+        template<typename TState, typename TEvent>
+        requires requires(Transitions& transitions, TState& state, const TEvent& event, AccountManager& account) {
+            transitions.transition(state, event, account);
         }
+        decltype(auto) transition(TState& state, const TEvent& event) {
+            return Transitions::transition(state, event, account);
+        }
+    };
+    static_assert(!std::is_polymorphic_v<OrderFSM<OrderType::LIMIT, OrderSide::BUY>>, "orders carry no vtable pointer");
+
+    class OrderRecord;
+
+    // the data of an `OrderRecord`, without the account it books against
+    class OrderRecordData: public fsm::Fsm<OrderRecord, states, fsm::dispatch::Visit, fsm::policy::Ignore, deferred,
+                                           posted> {
+    public:
+        using events = orderfsm::events;
+
+        Exchange exchange_id{};
+        Market market_id{};
+        TimeInForce time_in_force{};
+        Strategy strategy_id{};
+        int order_id{};
+        int price{};
+        int volume{};
+
+        OrderRecordData(Exchange exchange_id, Market market_id, TimeInForce time_in_force, Strategy strategy_id,
+                        int order_id, AccountManager& account, int price, int volume)
+        : exchange_id(exchange_id), market_id(market_id), time_in_force(time_in_force), strategy_id(strategy_id),
+          order_id(order_id), price(price), volume(volume) {
+            account.available_USD -= volume * price;
+        }
+    };
+
+    // A limit buy order kept by value in a `fsm::DensePool`, with the transitions of `OrderFSM<LIMIT, BUY>`. It has
+    // no expiry timer pointing back at it (a good till date record is expired by a sweep over the deadlines handing
+    // it `Event::Expired` instead), so moving it with memcpy is safe and the pool compacts orders with memmove once
+    // filled or cancelled ones are removed. Instead of storing its account the order gets it as the context of
+    // `process(event, account)`, so a batch of orders shares one ledger and each order is 8 bytes smaller.
+    class OrderRecord: public LimitBuyTransitions<OrderRecordData> {
+    public:
+        using context = AccountManager;
+        static constexpr bool trivially_relocatable = trivially_relocatable_storage;
+
+        using LimitBuyTransitions::LimitBuyTransitions;
+    };
+    static_assert(fsm::is_trivially_relocatable_v<OrderRecord>, "order records are compacted with memmove");
+
+    // risk status of an order, tracked next to its lifecycle as an orthogonal region
+    struct RiskState {
+        struct Normal {};
+        struct Throttled {};    // no new orders or modifications are sent
+        struct KillSwitched {}; // trading stopped, only a manual reset leaves this state
     };
+
+    using risk_states = std::variant<RiskState::Normal, RiskState::Throttled, RiskState::KillSwitched>;
+
+    struct RiskEvent {
+        struct Throttle {};
+        struct Resume {};
+        struct KillSwitch {};
+    };
+
+    class RiskFSM: public fsm::Fsm<RiskFSM, risk_states> {
+    public:
+        RiskState::Throttled transition(RiskState::Normal&, const RiskEvent::Throttle&) { return {}; }
+        RiskState::Normal transition(RiskState::Throttled&, const RiskEvent::Resume&) { return {}; }
+        RiskState::KillSwitched transition(RiskState::Normal&, const RiskEvent::KillSwitch&) { return {}; }
+        RiskState::KillSwitched transition(RiskState::Throttled&, const RiskEvent::KillSwitch&) { return {}; }
+        // an order rejected by the exchange throttles the strategy
+        RiskState::Throttled transition(RiskState::Normal&, const Event::Rejected&) { return {}; }
+    };
+
+    // one `process` call drives both regions, each event only reaches the regions reacting to it
+    using TrackedOrder = fsm::Regions<OrderFSM<OrderType::LIMIT, OrderSide::BUY>, RiskFSM>;
 }
 #endif //EXAMPLE_ORDERFSM_HPP
@@ -0,0 +1,23 @@
+#ifndef FSM_AFFINITY_HPP
+#define FSM_AFFINITY_HPP
+#include <cstddef>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace fsm::detail {
+    // pins the calling thread to `cpu`, a no-op where thread affinity isn't supported
+    inline void pin_current_thread(int cpu) {
+#if defined(__linux__)
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(static_cast<std::size_t>(cpu) % static_cast<std::size_t>(CPU_SETSIZE), &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#else
+        (void)cpu;
+#endif
+    }
+}
+#endif //FSM_AFFINITY_HPP
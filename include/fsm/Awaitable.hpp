@@ -0,0 +1,230 @@
+#ifndef FSM_AWAITABLE_HPP
+#define FSM_AWAITABLE_HPP
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <utility>
+
+#include "FSM.hpp"
+
+namespace fsm {
+    namespace detail {
+        // Thread local free lists of coroutine frames, one per size class of 64 bytes up to 1 KiB. A released frame
+        // goes to the list of the releasing thread and is reused by the next coroutine of that size class started
+        // there, so only the first coroutines of a thread reach the heap. Larger frames always do.
+        class FramePool {
+        public:
+            static void* allocate(std::size_t size) {
+                const auto size_class = class_of(size);
+                if (size_class >= CLASSES)
+                    return ::operator new(size);
+                auto& free = lists().free[size_class];
+                if (free == nullptr)
+                    return ::operator new((size_class + 1) * GRANULARITY);
+                return std::exchange(free, free->next);
+            }
+
+            static void deallocate(void* frame, std::size_t size) {
+                const auto size_class = class_of(size);
+                if (size_class >= CLASSES) {
+                    ::operator delete(frame);
+                    return;
+                }
+                auto& free = lists().free[size_class];
+                free = ::new(frame) Block{free};
+            }
+        private:
+            static constexpr std::size_t GRANULARITY = 64;
+            static constexpr std::size_t CLASSES = 16;
+
+            struct Block {
+                Block* next;
+            };
+
+            struct Lists {
+                std::array<Block*, CLASSES> free{};
+
+                ~Lists() {
+                    for (auto block : free) {
+                        while (block != nullptr)
+                            ::operator delete(std::exchange(block, block->next));
+                    }
+                }
+            };
+
+            static std::size_t class_of(std::size_t size) { return (size - 1) / GRANULARITY; }
+
+            static Lists& lists() {
+                thread_local Lists lists;
+                return lists;
+            }
+        };
+    }
+
+    // Fire-and-forget coroutine for strategy code, e.g. "send order, await ack, await fill". It runs eagerly up to
+    // its first suspension; `Awaitable::process` resumes it later. Frames come from `detail::FramePool`.
+    // Destroying the task destroys a suspended coroutine and withdraws whatever it was waiting for.
+    class Task {
+    public:
+        struct promise_type {
+            Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            // kept until the task is destroyed, so `done` can be asked
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+
+            static void* operator new(std::size_t size) { return detail::FramePool::allocate(size); }
+            static void operator delete(void* frame, std::size_t size) { detail::FramePool::deallocate(frame, size); }
+        };
+
+        Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                if (m_handle)
+                    m_handle.destroy();
+                m_handle = std::exchange(other.m_handle, {});
+            }
+            return *this;
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() {
+            if (m_handle)
+                m_handle.destroy();
+        }
+
+        bool done() const { return !m_handle || m_handle.done(); }
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    // Wraps a state machine so coroutines can wait for it to reach a state: `co_await order.until<State::Placed>()`.
+    // A waiting coroutine is resumed inline by the `process` call that entered the state, on the thread calling it,
+    // e.g. the worker draining its inbox, also when a posted or replayed deferred event left the state again before
+    // `process` returned (see `Fsm::process_recording`). Waiters are resumed in the order they started waiting.
+    // Waiting costs no allocation, the waiter is linked into an intrusive list from the coroutine frame.
+    // Like `process`, `until` must only be called from the thread owning the instance.
+    template<typename TFsm>
+    class Awaitable {
+        struct Waiter {
+            Waiter* previous{};
+            Waiter* next{};
+            std::coroutine_handle<> handle;
+            std::uint64_t state{};  // bit of the awaited state
+            std::uint64_t since{};  // the last `process` call started before the waiter was linked
+        };
+    public:
+        template<typename TState>
+        class Until: Waiter {
+        public:
+            explicit Until(Awaitable& awaitable) : m_awaitable(awaitable) {
+                this->state = std::uint64_t{1} << detail::variant_index_v<TState, typename TFsm::variants>;
+            }
+            Until(const Until&) = delete;
+            Until& operator=(const Until&) = delete;
+            // a coroutine destroyed while waiting stops waiting
+            ~Until() {
+                if (this->handle)
+                    m_awaitable.unlink(this);
+            }
+
+            bool await_ready() const { return m_awaitable.m_fsm.template is_in<TState>(); }
+            void await_suspend(std::coroutine_handle<> handle) {
+                this->handle = handle;
+                m_awaitable.link(this);
+            }
+            void await_resume() const {}
+        private:
+            Awaitable& m_awaitable;
+        };
+
+        template<typename... Args>
+        explicit Awaitable(Args&&... args) : m_fsm(std::forward<Args>(args)...) {}
+
+        Awaitable(const Awaitable&) = delete;
+        Awaitable& operator=(const Awaitable&) = delete;
+
+        // completes at once when the instance already is in `TState`
+        template<typename TState>
+        Until<TState> until() { return Until<TState>{*this}; }
+
+        // `context` is passed on to `TFsm::process`; while anyone waits every state entered on the way is recorded
+        template<typename Event, typename... TContext>
+        Result process(Event&& event, TContext&... context) {
+            if (m_head == nullptr)
+                return m_fsm.process(std::forward<Event>(event), context...);
+            return process_awaited(std::forward<Event>(event), context...);
+        }
+
+        template<typename TState>
+        bool is_in() const { return m_fsm.template is_in<TState>(); }
+        std::size_t state_index() const { return m_fsm.state_index(); }
+        bool is_terminal() const { return m_fsm.is_terminal(); }
+
+        // events processed through the wrapped instance directly don't resume anyone
+        TFsm& fsm() { return m_fsm; }
+        const TFsm& fsm() const { return m_fsm; }
+    private:
+        TFsm m_fsm;
+        Waiter* m_head{};
+        Waiter* m_tail{};
+        // `process` calls started while anyone was waiting
+        std::uint64_t m_epoch{};
+
+        template<typename Event, typename... TContext>
+        [[gnu::noinline]] Result process_awaited(Event&& event, TContext&... context) {
+            const auto epoch = ++m_epoch;
+            std::uint64_t entered = 0;
+            const auto result = m_fsm.process_recording(entered, std::forward<Event>(event), context...);
+            if (entered != 0)
+                resume(entered, epoch);
+            return result;
+        }
+
+        void link(Waiter* waiter) {
+            waiter->since = m_epoch;
+            waiter->previous = m_tail;
+            waiter->next = nullptr;
+            if (m_tail != nullptr)
+                m_tail->next = waiter;
+            else
+                m_head = waiter;
+            m_tail = waiter;
+        }
+
+        void unlink(Waiter* waiter) {
+            if (waiter->previous != nullptr)
+                waiter->previous->next = waiter->next;
+            else
+                m_head = waiter->next;
+            if (waiter->next != nullptr)
+                waiter->next->previous = waiter->previous;
+            else
+                m_tail = waiter->previous;
+            waiter->handle = {};
+        }
+
+        // Resumes the waiters for one of the `entered` states that were waiting when the `process` call `epoch`
+        // started; the ones linked since then wait for later entries. A resumed coroutine may process events, wait
+        // again or finish and destroy other waiters, so the scan starts over after every resumption.
+        void resume(std::uint64_t entered, std::uint64_t epoch) {
+            for (auto waiter = m_head; waiter != nullptr;) {
+                if ((waiter->state & entered) == 0 || waiter->since >= epoch) {
+                    waiter = waiter->next;
+                    continue;
+                }
+                const auto handle = waiter->handle;
+                unlink(waiter);
+                handle.resume();
+                waiter = m_head;
+            }
+        }
+    };
+}
+#endif //FSM_AWAITABLE_HPP
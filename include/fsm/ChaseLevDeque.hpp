@@ -0,0 +1,84 @@
+#ifndef FSM_CHASELEVDEQUE_HPP
+#define FSM_CHASELEVDEQUE_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace fsm {
+    // Chase-Lev work-stealing deque of trivially copyable items (Lê et al., "Correct and efficient work-stealing for
+    // weak memory models"). The owner pushes and pops at the bottom, any other thread steals from the top.
+    // The capacity is fixed at construction, `push` returns false instead of growing the buffer.
+    template<typename T>
+    class ChaseLevDeque {
+        static_assert(std::is_trivially_copyable_v<T>);
+    public:
+        // rounded up to a power of two
+        explicit ChaseLevDeque(std::size_t capacity) {
+            std::size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            m_mask = static_cast<std::int64_t>(size - 1);
+            m_buffer = std::make_unique<std::atomic<T>[]>(size);
+        }
+
+        // owner only
+        bool push(T item) {
+            const auto bottom = m_bottom.load(std::memory_order_relaxed);
+            const auto top = m_top.load(std::memory_order_acquire);
+            if (bottom - top > m_mask)
+                return false;
+            m_buffer[bottom & m_mask].store(item, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // owner only, newest item first
+        std::optional<T> pop() {
+            const auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = m_top.load(std::memory_order_relaxed);
+            if (top > bottom) {
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            std::optional<T> item = m_buffer[bottom & m_mask].load(std::memory_order_relaxed);
+            if (top == bottom) {
+                // last item, race against thieves
+                if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    item.reset();
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        // any thread, oldest item first; empty when the deque is empty or another thief won the race
+        std::optional<T> steal() {
+            auto top = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto bottom = m_bottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+                return std::nullopt;
+            T item = m_buffer[top & m_mask].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return std::nullopt;
+            return item;
+        }
+
+        // approximate when called concurrently with thieves
+        std::size_t size() const {
+            const auto size = m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+            return size > 0 ? static_cast<std::size_t>(size) : 0;
+        }
+    private:
+        alignas(64) std::atomic<std::int64_t> m_top{};
+        alignas(64) std::atomic<std::int64_t> m_bottom{};
+        std::int64_t m_mask{};
+        std::unique_ptr<std::atomic<T>[]> m_buffer;
+    };
+}
+#endif //FSM_CHASELEVDEQUE_HPP
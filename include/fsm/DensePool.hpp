@@ -0,0 +1,186 @@
+#ifndef FSM_DENSEPOOL_HPP
+#define FSM_DENSEPOOL_HPP
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "FSM.hpp"
+#include "Relocation.hpp"
+
+namespace fsm {
+    // Keeps live instances of a state machine in one contiguous array, for scans touching every instance. Like
+    // `fsm::InstancePool` it destroys an instance as soon as `process` takes it into a terminal state and hands out
+    // generation tagged handles, but these name a slot of an indirection table, so instances can move: the hole an
+    // instance leaves is closed by `compact`, which slides every run of live instances down with one `fsm::relocate`,
+    // a memmove for trivially relocatable instances, keeping their order. Single threaded.
+    template<typename TFsm>
+    class DensePool {
+    public:
+        // index of the slot in the lower half, its generation in the upper half
+        using Handle = std::uint64_t;
+
+        static constexpr Handle NO_INSTANCE = std::numeric_limits<Handle>::max();
+
+        DensePool() = default;
+        DensePool(const DensePool&) = delete;
+        DensePool& operator=(const DensePool&) = delete;
+        ~DensePool() {
+            for (std::size_t position = 0; position < m_owners.size(); position++) {
+                if (m_owners[position] != NIL)
+                    std::destroy_at(at(position));
+            }
+            ::operator delete(m_instances, std::align_val_t{alignof(TFsm)});
+        }
+
+        void reserve(std::size_t capacity) {
+            if (capacity > m_capacity)
+                reallocate(capacity);
+        }
+
+        template<typename... Args>
+        Handle emplace(Args&&... args) {
+            if (m_owners.size() == m_capacity)
+                reallocate(m_capacity == 0 ? 64 : 2 * m_capacity);
+            const auto position = static_cast<std::uint32_t>(m_owners.size());
+            ::new(static_cast<void*>(m_instances + position)) TFsm(std::forward<Args>(args)...);
+
+            std::uint32_t index;
+            if (m_free != NIL) {
+                index = m_free;
+                m_free = m_slots[index].position;
+            } else {
+                index = static_cast<std::uint32_t>(m_slots.size());
+                m_slots.emplace_back();
+            }
+            m_slots[index].position = position;
+            m_slots[index].live = true;
+            m_owners.push_back(index);
+            m_size++;
+            return static_cast<Handle>(m_slots[index].generation) << 32 | index;
+        }
+
+        bool contains(Handle handle) const {
+            const auto index = static_cast<std::uint32_t>(handle);
+            return index < m_slots.size() && m_slots[index].generation == static_cast<std::uint32_t>(handle >> 32)
+                   && m_slots[index].live;
+        }
+
+        // nullptr for a stale handle; the instance moves on `compact` and when the pool grows
+        TFsm* get(Handle handle) {
+            return contains(handle) ? at(m_slots[static_cast<std::uint32_t>(handle)].position) : nullptr;
+        }
+
+        // A stale handle rejects the event without touching any instance. An instance left in a terminal state,
+        // also by an event posted by a transition that stayed, is destroyed before `process` returns, leaving a hole
+        // until the next `compact`. `context`, if any, is passed on to `TFsm::process`.
+        template<typename Event, typename... TContext>
+        Result process(Handle handle, Event&& event, TContext&... context) {
+            if (!contains(handle)) [[unlikely]]
+                return Result::Rejected;
+            auto& instance = *at(m_slots[static_cast<std::uint32_t>(handle)].position);
+            const auto result = instance.process(std::forward<Event>(event), context...);
+            if (instance.is_terminal())
+                release(static_cast<std::uint32_t>(handle));
+            return result;
+        }
+
+        // destroys an instance before it reached a terminal state; false for a stale handle
+        bool erase(Handle handle) {
+            if (!contains(handle))
+                return false;
+            release(static_cast<std::uint32_t>(handle));
+            return true;
+        }
+
+        // Closes the holes left by destroyed instances. Returns the number of closed holes.
+        std::size_t compact() {
+            const auto end = m_owners.size();
+            std::size_t to = 0;
+            for (std::size_t from = 0; from < end;) {
+                if (m_owners[from] == NIL) {
+                    from++;
+                    continue;
+                }
+                auto run = from;
+                while (run < end && m_owners[run] != NIL)
+                    run++;
+                if (to != from) {
+                    relocate(at(from), at(to), run - from);
+                    for (auto position = from; position < run; position++) {
+                        m_owners[to + position - from] = m_owners[position];
+                        m_slots[m_owners[position]].position = static_cast<std::uint32_t>(to + position - from);
+                    }
+                }
+                to += run - from;
+                from = run;
+            }
+            m_owners.resize(to);
+            return end - to;
+        }
+
+        // calls `f(TFsm&)` for every live instance, in the order they were emplaced
+        template<typename F>
+        void for_each(F&& f) {
+            for (std::size_t position = 0; position < m_owners.size(); position++) {
+                if (m_owners[position] != NIL)
+                    f(*at(position));
+            }
+        }
+
+        // live instances
+        std::size_t size() const { return m_size; }
+        // live instances and holes
+        std::size_t extent() const { return m_owners.size(); }
+    private:
+        static constexpr std::uint32_t NIL = std::numeric_limits<std::uint32_t>::max();
+
+        struct Slot {
+            std::uint32_t position{};   // of the instance, next free slot while released
+            std::uint32_t generation{};
+            bool live{};
+        };
+
+        TFsm* m_instances{};
+        std::size_t m_capacity{};
+        std::size_t m_size{};
+        // the slot owning the instance at each position, NIL for a hole
+        std::vector<std::uint32_t> m_owners;
+        std::vector<Slot> m_slots;
+        std::uint32_t m_free{NIL};
+
+        TFsm* at(std::size_t position) const { return std::launder(m_instances + position); }
+
+        void release(std::uint32_t index) {
+            auto& slot = m_slots[index];
+            std::destroy_at(at(slot.position));
+            m_owners[slot.position] = NIL;
+            slot.live = false;
+            slot.generation++;
+            slot.position = m_free;
+            m_free = index;
+            m_size--;
+        }
+
+        // instances keep their positions, holes included
+        [[gnu::noinline]] void reallocate(std::size_t capacity) {
+            auto instances = static_cast<TFsm*>(
+                    ::operator new(capacity * sizeof(TFsm), std::align_val_t{alignof(TFsm)}));
+            const auto end = m_owners.size();
+            for (std::size_t from = 0; from < end;) {
+                auto run = from;
+                while (run < end && m_owners[run] != NIL)
+                    run++;
+                relocate(at(from), instances + from, run - from);
+                from = run + 1;
+            }
+            ::operator delete(m_instances, std::align_val_t{alignof(TFsm)});
+            m_instances = instances;
+            m_capacity = capacity;
+        }
+    };
+}
+#endif //FSM_DENSEPOOL_HPP
@@ -1,31 +1,931 @@
 #ifndef SRC_FSM_FINITESTATEMACHINE_HPP
 #define SRC_FSM_FINITESTATEMACHINE_HPP
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <tuple>
+#include <type_traits>
 #include <variant>
 #include <utility>
 
+#include "InlineQueue.hpp"
+#include "Relocation.hpp"
+
 namespace fsm {
-    template<typename TChild, typename TVariants>
+    namespace detail {
+        template<typename T>
+        struct is_variant: std::false_type {};
+        template<typename... Ts>
+        struct is_variant<std::variant<Ts...>>: std::true_type {};
+        template<typename T>
+        inline constexpr bool is_variant_v = is_variant<T>::value;
+
+        template<typename T>
+        struct is_optional: std::false_type {};
+        template<typename T>
+        struct is_optional<std::optional<T>>: std::true_type {};
+        template<typename T>
+        inline constexpr bool is_optional_v = is_optional<T>::value;
+
+        template<typename T, typename TVariants>
+        struct variant_index;
+        template<typename T, typename... Ts>
+        struct variant_index<T, std::variant<Ts...>> {
+            static constexpr std::size_t value = [] {
+                constexpr bool matches[] = {std::is_same_v<T, Ts>...};
+                std::size_t index = 0;
+                while (!matches[index])
+                    ++index;
+                return index;
+            }();
+        };
+        template<typename T, typename TVariants>
+        inline constexpr std::size_t variant_index_v = variant_index<T, TVariants>::value;
+
+        template<typename T, typename TVariants>
+        struct is_alternative: std::false_type {};
+        template<typename T, typename... Ts>
+        struct is_alternative<T, std::variant<Ts...>>: std::bool_constant<(std::is_same_v<T, Ts> || ...)> {};
+        template<typename T, typename TVariants>
+        inline constexpr bool is_alternative_v = is_alternative<T, TVariants>::value;
+
+        // all alternatives carry no data, so the state is fully described by its index
+        template<typename TVariants>
+        struct is_stateless: std::false_type {};
+        template<typename... Ts>
+        struct is_stateless<std::variant<Ts...>>: std::bool_constant<
+                ((std::is_empty_v<Ts> && std::is_trivially_default_constructible_v<Ts>) && ...)> {};
+        template<typename TVariants>
+        inline constexpr bool is_stateless_v = is_stateless<TVariants>::value;
+
+        // the object handed to transitions for states that are stored as an index only
+        template<typename TState>
+        inline TState shared_state{};
+
+        // State storage for stateless state sets: a single byte holding the index of the current alternative.
+        // Assigning a state is a byte store, the alternatives themselves are shared empty objects.
+        template<typename TVariants>
+        class IndexStorage {
+        public:
+            using variants = TVariants;
+            using index_type = std::conditional_t<(std::variant_size_v<TVariants> <= 256), std::uint8_t, std::uint16_t>;
+
+            constexpr IndexStorage() = default;
+            template<typename TState> requires (!is_variant_v<TState>)
+            constexpr explicit IndexStorage(const TState& state) { *this = state; }
+
+            constexpr std::size_t index() const { return m_index; }
+
+            template<typename TState> requires (!is_variant_v<TState>)
+            constexpr IndexStorage& operator=(const TState&) {
+                m_index = static_cast<index_type>(variant_index_v<TState, TVariants>);
+                return *this;
+            }
+            constexpr IndexStorage& operator=(const TVariants& state) {
+                m_index = static_cast<index_type>(state.index());
+                return *this;
+            }
+            template<typename TState, typename... Args>
+            constexpr void emplace(Args&&...) { *this = TState{}; }
+            constexpr void set_index(std::size_t index) { m_index = static_cast<index_type>(index); }
+        private:
+            index_type m_index{};
+        };
+
+        template<typename TVariants>
+        using state_storage_t = std::conditional_t<is_stateless_v<TVariants>, IndexStorage<TVariants>, TVariants>;
+
+        // unchecked access to the alternative `StateIndex`, which must be the current one
+        template<std::size_t StateIndex, typename... Ts>
+        constexpr auto& get(std::variant<Ts...>& state) { return *std::get_if<StateIndex>(&state); }
+        template<std::size_t StateIndex, typename TVariants>
+        constexpr auto& get(IndexStorage<TVariants>&) {
+            return shared_state<std::variant_alternative_t<StateIndex, TVariants>>;
+        }
+
+        // unchecked access to the current state by type
+        template<typename TState, typename TStorage>
+        constexpr TState& get_as(TStorage& storage) {
+            if constexpr (is_variant_v<TStorage>)
+                return *std::get_if<TState>(&storage);
+            else
+                return shared_state<TState>;
+        }
+
+        // std::visit equivalent for both storages
+        template<typename F, typename... Ts>
+        constexpr decltype(auto) visit(F&& f, std::variant<Ts...>& state) { return std::visit(std::forward<F>(f), state); }
+        // a chain of compares on the index (which compilers turn into a switch) keeps the visitor inlinable;
+        // a non-void result has to be default constructible
+        template<typename F, typename TVariants>
+        constexpr decltype(auto) visit(F&& f, IndexStorage<TVariants>& state) {
+            using R = std::invoke_result_t<F&, std::variant_alternative_t<0, TVariants>&>;
+            const auto index = state.index();
+            return [&]<std::size_t... StateIndex>(std::index_sequence<StateIndex...>) -> R {
+                if constexpr (std::is_void_v<R>) {
+                    (void)((index == StateIndex
+                            && (f(shared_state<std::variant_alternative_t<StateIndex, TVariants>>), true)) || ...);
+                } else {
+                    R result{};
+                    (void)((index == StateIndex
+                            && (result = f(shared_state<std::variant_alternative_t<StateIndex, TVariants>>), true)) || ...);
+                    return result;
+                }
+            }(std::make_index_sequence<std::variant_size_v<TVariants>>{});
+        }
+    }
+
+    // outcome of `Fsm::process`
+    enum class Result : std::uint8_t {
+        Transitioned,   // a transition was taken
+        Unchanged,      // the guard of the transition chose `fsm::Stay`
+        Rejected,       // no transition for this state/event pair, or its guard returned an empty optional/`fsm::Reject`
+        Deferred        // the transition returned `fsm::Defer`, the event is replayed after the next state change
+    };
+
+    // what happens to rejected events besides returning `Result::Rejected`; none of them throws
+    namespace policy {
+        // drop the event
+        struct Ignore {
+            template<typename TChild, typename TState, typename TEvent>
+            constexpr void operator()(TChild&, const TState&, const TEvent&) {}
+        };
+
+        // count rejected events, see `Fsm::rejection_policy().rejected`
+        struct Count {
+            std::size_t rejected{};
+
+            template<typename TChild, typename TState, typename TEvent>
+            constexpr void operator()(TChild&, const TState&, const TEvent&) { ++rejected; }
+        };
+
+        // call `on_invalid_transition(const State&, const Event&)` on the child
+        struct InvokeHandler {
+            template<typename TChild, typename TState, typename TEvent>
+            constexpr void operator()(TChild& child, const TState& state, const TEvent& event) {
+                child.on_invalid_transition(state, event);
+            }
+        };
+    }
+
+    // Returned by a transition to construct the next state directly in the state machine's storage, after the
+    // previous state has been destroyed. The arguments are held by value, so they may be moved out of the previous
+    // state.
+    template<typename TState, typename... Args>
+    struct Emplace {
+        std::tuple<Args...> args;
+    };
+
+    template<typename TState, typename... Args>
+    constexpr Emplace<TState, std::decay_t<Args>...> emplace(Args&&... args) {
+        return {{std::forward<Args>(args)...}};
+    }
+
+    // Returned by a transition to keep the event until the state changes, e.g. a fill arriving while a modification
+    // is pending. The transition is never called, a declaration is enough. See `deferral::Queue`.
+    struct Defer {};
+
+    // where `fsm::Fsm` keeps deferred events, selected with its fifth template parameter
+    namespace deferral {
+        // nothing is kept: `process` returns `Result::Deferred` and the caller owns the event
+        struct None {};
+
+        // Up to `Capacity` events of the listed types in a ring stored inside the state machine. They are replayed
+        // in arrival order after every transition, until none of them leads to another one. When the ring is full,
+        // the event goes to the rejection policy.
+        template<std::size_t Capacity, typename... Events>
+        struct Queue {
+            using events = std::variant<Events...>;
+            static constexpr bool trivially_relocatable = InlineQueue<events, Capacity>::trivially_relocatable;
+
+            InlineQueue<events, Capacity> pending;
+        };
+    }
+
+    // where `fsm::Fsm` keeps events posted by transitions, selected with its sixth template parameter
+    namespace posting {
+        // transitions can't post events
+        struct None {};
+
+        // Transitions call `post(event)` to raise up to `Capacity` follow-up events of the listed types, e.g. a fill
+        // that brings the open volume to zero raising `Filled`. They are processed in posting order, after the
+        // current transition and before `process` returns, by a loop in `process` instead of recursion.
+        template<std::size_t Capacity, typename... Events>
+        struct Queue {
+            using events = std::variant<Events...>;
+            static constexpr bool trivially_relocatable = InlineQueue<events, Capacity>::trivially_relocatable;
+
+            InlineQueue<events, Capacity> posted;
+        };
+    }
+
+    // Base of a superstate: a group of states, or of other superstates, handling events on behalf of its members.
+    // The child lists its superstates with `using superstates = std::tuple<...>` and writes transitions taking the
+    // superstate (`transition(LiveInBook&, const Cancelled&)`). A member without a transition of its own for an event
+    // uses the one of its closest superstate. The lookup is done at compile time for every state/event pair, so
+    // dispatch stays flat.
+    template<typename... TMembers>
+    struct Superstate {
+        using members = std::tuple<TMembers...>;
+    };
+
+    // targets of a guarded transition besides states, see `OneOf`
+    struct Stay {};     // keep the current state, `process` returns `Result::Unchanged`
+    struct Reject {};   // refuse the event, it goes to the rejection policy
+
+    // Return type of a guarded transition: one of a subset of the states, `Stay` or `Reject`. When the alternatives
+    // carry no data it is a single byte, instead of a `std::optional` of the whole state variant.
+    template<typename... TTargets>
+    class OneOf {
+    public:
+        using targets = std::variant<TTargets...>;
+
+        template<typename TTarget> requires (std::is_same_v<TTarget, TTargets> || ...)
+        constexpr OneOf(TTarget target): m_target(std::move(target)) {}
+
+        constexpr std::size_t index() const { return m_target.index(); }
+        constexpr detail::state_storage_t<targets>& target() { return m_target; }
+    private:
+        detail::state_storage_t<targets> m_target;
+    };
+
+    namespace detail {
+        template<typename T>
+        struct is_one_of: std::false_type {};
+        template<typename... TTargets>
+        struct is_one_of<OneOf<TTargets...>>: std::true_type {};
+
+        template<typename T>
+        struct is_emplace: std::false_type {};
+        template<typename TState, typename... Args>
+        struct is_emplace<Emplace<TState, Args...>>: std::true_type {
+            using state_type = TState;
+        };
+
+        template<typename TStorage, typename TState, typename... Args>
+        void emplace(TStorage& storage, Emplace<TState, Args...>&& new_state) {
+            std::apply([&](Args&... args) { storage.template emplace<TState>(std::move(args)...); }, new_state.args);
+        }
+
+        template<typename TChild, typename TState, typename TEvent>
+        concept HasTransition = requires(TChild& child, TState& state, TEvent&& event) {
+            child.transition(state, std::forward<TEvent>(event));
+        };
+
+        template<typename T, typename TTuple>
+        struct is_member: std::false_type {};
+        template<typename T, typename... Ts>
+        struct is_member<T, std::tuple<Ts...>>: std::bool_constant<(std::is_same_v<T, Ts> || ...)> {};
+
+        template<typename TChild>
+        struct superstates_of {
+            using type = std::tuple<>;
+        };
+        template<typename TChild> requires requires { typename TChild::superstates; }
+        struct superstates_of<TChild> {
+            using type = typename TChild::superstates;
+        };
+
+        // the first of `TSuperstates` having `TState` as a member, void for none
+        template<typename TState, typename TSuperstates>
+        struct parent {
+            using type = void;
+        };
+        template<typename TState, typename TSuperstate, typename... TSuperstates>
+        struct parent<TState, std::tuple<TSuperstate, TSuperstates...>>: std::conditional_t<
+                is_member<TState, typename TSuperstate::members>::value,
+                std::type_identity<TSuperstate>, parent<TState, std::tuple<TSuperstates...>>> {};
+
+        // the state whose transition handles `TEvent` in `TState`: the state itself, its closest superstate having
+        // a transition for the event, or void when there is none
+        template<typename TChild, typename TState, typename TEvent>
+        struct handler: std::conditional_t<HasTransition<TChild, TState, TEvent>, std::type_identity<TState>,
+                handler<TChild, typename parent<TState, typename superstates_of<TChild>::type>::type, TEvent>> {};
+        template<typename TChild, typename TEvent>
+        struct handler<TChild, void, TEvent> {
+            using type = void;
+        };
+        template<typename TChild, typename TState, typename TEvent>
+        using handler_t = typename handler<TChild, TState, TEvent>::type;
+
+        template<typename TChild, typename TState, typename TEvent>
+        concept Defers = requires(TChild& child, TState& state, TEvent&& event) {
+            { child.transition(state, std::forward<TEvent>(event)) } -> std::same_as<Defer>;
+        };
+        // the event is deferred in at least one state
+        template<typename TChild, typename TVariants, typename TEvent>
+        struct can_defer;
+        template<typename TChild, typename... Ts, typename TEvent>
+        struct can_defer<TChild, std::variant<Ts...>, TEvent>: std::bool_constant<
+                ((!std::is_void_v<handler_t<TChild, Ts, TEvent>>
+                  && Defers<TChild, handler_t<TChild, Ts, TEvent>, TEvent>) || ...)> {};
+        template<typename TChild, typename TVariants, typename TEvent>
+        inline constexpr bool can_defer_v = can_defer<TChild, TVariants, TEvent>::value;
+
+        // the events the child declares with `using events = std::variant<...>`, none when it doesn't
+        template<typename TChild>
+        struct events_of {
+            using type = std::variant<>;
+        };
+        template<typename TChild> requires requires { typename TChild::events; }
+        struct events_of<TChild> {
+            using type = typename TChild::events;
+        };
+
+        // A terminal state handles none of the child's events, neither itself nor through a superstate. Without
+        // declared events no state is terminal.
+        template<typename TChild, typename TState, typename TEvents>
+        struct is_terminal_state;
+        template<typename TChild, typename TState, typename... Events>
+        struct is_terminal_state<TChild, TState, std::variant<Events...>>: std::bool_constant<
+                (sizeof...(Events) > 0 && (std::is_void_v<handler_t<TChild, TState, const Events&>> && ...))> {};
+
+        template<typename TChild, typename TVariants, typename TEvents = typename events_of<TChild>::type>
+        struct terminal_states;
+        template<typename TChild, typename... Ts, typename TEvents>
+        struct terminal_states<TChild, std::variant<Ts...>, TEvents> {
+            static constexpr std::array<bool, sizeof...(Ts)> table{is_terminal_state<TChild, Ts, TEvents>::value...};
+            static constexpr bool any = [] {
+                for (auto terminal : table) {
+                    if (terminal)
+                        return true;
+                }
+                return false;
+            }();
+            // bit `i` for the `i`-th state, so testing a state index takes a single instruction
+            static constexpr std::uint64_t mask = [] {
+                std::uint64_t bits = 0;
+                for (std::size_t index = 0; index < table.size() && index < 64; index++)
+                    bits |= std::uint64_t{table[index]} << index;
+                return bits;
+            }();
+
+            static constexpr bool contains(std::size_t index) {
+                if constexpr (sizeof...(Ts) <= 64)
+                    return (mask >> index) & 1;
+                else
+                    return table[index];
+            }
+        };
+
+        // the event, or every alternative of an event variant, is one of the child's declared events
+        template<typename TEvent, typename TEvents>
+        struct is_declared_event: is_alternative<TEvent, TEvents> {};
+        template<typename... Ts, typename TEvents>
+        struct is_declared_event<std::variant<Ts...>, TEvents>: std::bool_constant<
+                (is_alternative_v<Ts, TEvents> && ...)> {};
+
+        // the shared object the child's transitions may take as a third argument, declared with `using context`
+        template<typename TChild>
+        struct context_of {
+            using type = void;
+        };
+        template<typename TChild> requires requires { typename TChild::context; }
+        struct context_of<TChild> {
+            using type = typename TChild::context;
+        };
+        template<typename TChild>
+        using context_of_t = typename context_of<TChild>::type;
+
+        // The child as seen by `step` while an event is processed with a context: transitions taking the context
+        // get it, the others are called as usual. Hooks and timers are forwarded to the child.
+        template<typename TChild, typename TContext>
+        struct WithContext {
+            using superstates = typename superstates_of<TChild>::type;
+            using events = typename events_of<TChild>::type;
+
+            TChild& child;
+            TContext& context;
+
+            template<typename TState, typename TEvent>
+            requires requires(TChild& child, TState& state, TEvent&& event, TContext& context) {
+                child.transition(state, std::forward<TEvent>(event), context);
+            }
+            decltype(auto) transition(TState& state, TEvent&& event) {
+                return child.transition(state, std::forward<TEvent>(event), context);
+            }
+            template<typename TState, typename TEvent>
+            requires (!requires(TChild& child, TState& state, TEvent&& event, TContext& context) {
+                child.transition(state, std::forward<TEvent>(event), context);
+            } && HasTransition<TChild, TState, TEvent>)
+            decltype(auto) transition(TState& state, TEvent&& event) {
+                return child.transition(state, std::forward<TEvent>(event));
+            }
+
+            template<typename TState> requires requires(TChild& child, TState& state) { child.on_entry(state); }
+            void on_entry(TState& state) { child.on_entry(state); }
+            template<typename TState> requires requires(TChild& child, TState& state) { child.on_exit(state); }
+            void on_exit(TState& state) { child.on_exit(state); }
+            template<typename TFrom, typename TEvent, typename TTo>
+            requires requires(TChild& child, TFrom& from, TEvent& event, TTo& to) {
+                child.on_transition(from, event, to);
+            }
+            void on_transition(TFrom& from, TEvent& event, TTo& to) { child.on_transition(from, event, to); }
+            template<typename TState, typename TEvent>
+            requires requires(TChild& child, const TState& state, const TEvent& event) {
+                child.on_invalid_transition(state, event);
+            }
+            void on_invalid_transition(const TState& state, const TEvent& event) {
+                child.on_invalid_transition(state, event);
+            }
+
+            decltype(auto) state_timer() requires requires(TChild& child) { child.state_timer(); } {
+                return child.state_timer();
+            }
+            template<typename TState> requires requires(TChild& child, TState& state) { child.timeout(state); }
+            decltype(auto) timeout(TState& state) { return child.timeout(state); }
+        };
+
+        // the type `step` sees as the child when events come with the child's context
+        template<typename TChild>
+        using bound_t = std::conditional_t<std::is_void_v<context_of_t<TChild>>, TChild,
+                WithContext<TChild, context_of_t<TChild>>>;
+
+        // The child as seen by `step` during `Fsm::process_recording`: entering the `i`-th state sets bit `i` of
+        // `entered`. Everything else is forwarded to the child, or to the child bound to its context.
+        template<typename TBound, typename TVariants>
+        struct RecordingEntries {
+            using superstates = typename superstates_of<TBound>::type;
+            using events = typename events_of<TBound>::type;
+
+            TBound& child;
+            std::uint64_t& entered;
+
+            template<typename TState, typename TEvent> requires HasTransition<TBound, TState, TEvent>
+            decltype(auto) transition(TState& state, TEvent&& event) {
+                return child.transition(state, std::forward<TEvent>(event));
+            }
+
+            template<typename TState>
+            void on_entry(TState& state) {
+                entered |= std::uint64_t{1} << variant_index_v<TState, TVariants>;
+                if constexpr (requires { child.on_entry(state); })
+                    child.on_entry(state);
+            }
+            template<typename TState> requires requires(TBound& child, TState& state) { child.on_exit(state); }
+            void on_exit(TState& state) { child.on_exit(state); }
+            template<typename TFrom, typename TEvent, typename TTo>
+            requires requires(TBound& child, TFrom& from, TEvent& event, TTo& to) {
+                child.on_transition(from, event, to);
+            }
+            void on_transition(TFrom& from, TEvent& event, TTo& to) { child.on_transition(from, event, to); }
+            template<typename TState, typename TEvent>
+            requires requires(TBound& child, const TState& state, const TEvent& event) {
+                child.on_invalid_transition(state, event);
+            }
+            void on_invalid_transition(const TState& state, const TEvent& event) {
+                child.on_invalid_transition(state, event);
+            }
+
+            decltype(auto) state_timer() requires requires(TBound& child) { child.state_timer(); } {
+                return child.state_timer();
+            }
+            template<typename TState> requires requires(TBound& child, TState& state) { child.timeout(state); }
+            decltype(auto) timeout(TState& state) { return child.timeout(state); }
+        };
+
+        // optional hooks of the child, detected per state (and event) type
+        template<typename TChild, typename TState>
+        concept HasOnEntry = requires(TChild& child, TState& state) { child.on_entry(state); };
+        template<typename TChild, typename TState>
+        concept HasOnExit = requires(TChild& child, TState& state) { child.on_exit(state); };
+        template<typename TChild, typename TFrom, typename TEvent, typename TTo>
+        concept HasOnTransition = requires(TChild& child, TFrom& from, TEvent& event, TTo& to) {
+            child.on_transition(from, event, to);
+        };
+
+        // a state (or superstate) with a timeout: `timeout(state)` returns the deadline, `state_timer()` the timer
+        // armed with it (see `fsm::StateTimer`)
+        template<typename TChild, typename TState>
+        concept HasTimeout = requires(TChild& child, TState& state) {
+            child.state_timer().arm(child.timeout(state));
+            child.state_timer().cancel();
+        };
+
+        // the state whose timeout applies in `TState`: the state itself, its closest superstate with a timeout, or
+        // void for none
+        template<typename TChild, typename TState>
+        struct timed_scope: std::conditional_t<HasTimeout<TChild, TState>, std::type_identity<TState>,
+                timed_scope<TChild, typename parent<TState, typename superstates_of<TChild>::type>::type>> {};
+        template<typename TChild>
+        struct timed_scope<TChild, void> {
+            using type = void;
+        };
+        template<typename TChild, typename TState>
+        using timed_scope_t = typename timed_scope<TChild, TState>::type;
+
+        template<typename TChild, typename TFrom, typename TTo>
+        inline constexpr bool retimes_v = !std::is_same_v<timed_scope_t<TChild, TFrom>, timed_scope_t<TChild, TTo>>;
+
+        template<typename TChild, typename TFrom, typename TEvent, typename TTo>
+        struct has_hooks: std::bool_constant<HasOnExit<TChild, TFrom> || HasOnEntry<TChild, TTo>
+                || HasOnTransition<TChild, TFrom, TEvent, TTo> || retimes_v<TChild, TFrom, TTo>> {};
+        template<typename TChild, typename TFrom, typename TEvent, typename... Ts>
+        struct has_hooks<TChild, TFrom, TEvent, std::variant<Ts...>>: std::bool_constant<
+                (has_hooks<TChild, TFrom, TEvent, Ts>::value || ...)> {};
+
+        // `Stay` and `Reject` enter no state, so they run no hook and touch no timer
+        template<typename TChild, typename TFrom, typename TEvent, typename TTarget>
+        inline constexpr bool target_has_hooks_v = !std::is_same_v<TTarget, Stay> && !std::is_same_v<TTarget, Reject>
+                && has_hooks<TChild, TFrom, TEvent, TTarget>::value;
+
+        template<typename TChild, typename TState>
+        constexpr void on_entry(TChild& child, TState& state) {
+            if constexpr (HasOnEntry<TChild, TState>)
+                child.on_entry(state);
+        }
+        template<typename TChild, typename TState>
+        constexpr void on_exit(TChild& child, TState& state) {
+            if constexpr (HasOnExit<TChild, TState>)
+                child.on_exit(state);
+        }
+        template<typename TChild, typename TFrom, typename TEvent, typename TTo>
+        constexpr void on_transition(TChild& child, TFrom& from, TEvent& event, TTo& to) {
+            if constexpr (HasOnTransition<TChild, TFrom, TEvent, TTo>)
+                child.on_transition(from, event, to);
+        }
+
+        // Cancels the timer of the state left and arms the one of the state entered. Moving between members of a
+        // superstate with a timeout keeps its timer running.
+        template<typename TFrom, typename TChild, typename TTo>
+        constexpr void retime(TChild& child, TTo& to) {
+            using TFromScope = timed_scope_t<TChild, TFrom>;
+            using TToScope = timed_scope_t<TChild, TTo>;
+            if constexpr (!std::is_same_v<TFromScope, TToScope>) {
+                // arming cancels the running timer
+                if constexpr (std::is_same_v<TToScope, TTo>)
+                    child.state_timer().arm(child.timeout(to));
+                else if constexpr (!std::is_void_v<TToScope>)
+                    child.state_timer().arm(child.timeout(shared_state<TToScope>));
+                else
+                    child.state_timer().cancel();
+            }
+        }
+
+        // exit `state`, run the transition hook, store `new_state` and enter it
+        template<typename TChild, typename TStorage, typename TState, typename TEvent, typename TNewState>
+        void commit(TChild& child, TStorage& storage, TState& state, TEvent& event, TNewState&& new_state) {
+            using TTo = std::remove_cvref_t<TNewState>;
+            if constexpr (!has_hooks<TChild, TState, TEvent, TTo>::value) {
+                storage = std::forward<TNewState>(new_state);
+            } else if constexpr (is_variant_v<TTo>) {
+                std::visit([&](auto& to) { commit(child, storage, state, event, std::move(to)); }, new_state);
+            } else {
+                on_exit(child, state);
+                on_transition(child, state, event, new_state);
+                storage = std::forward<TNewState>(new_state);
+                retime<TState>(child, get_as<TTo>(storage));
+                on_entry(child, get_as<TTo>(storage));
+            }
+        }
+
+        // Stores the target chosen by a guarded transition. When both the states and the targets are plain indices
+        // and there are no hooks, the chosen target is mapped to the new state index and the result through constexpr
+        // tables, without branching on the guard's outcome.
+        template<typename TPolicy, typename TChild, typename TStorage, typename TState, typename TEvent,
+                typename... TTargets>
+        Result commit_one_of(TPolicy& policy, TChild& child, TStorage& storage, TState& state, TEvent& event,
+                             OneOf<TTargets...>& new_state) {
+            using targets = typename OneOf<TTargets...>::targets;
+            if constexpr (requires { typename TStorage::variants; } && is_stateless_v<targets>
+                          && !(std::is_same_v<TTargets, Reject> || ...)
+                          && !(target_has_hooks_v<TChild, TState, TEvent, TTargets> || ...)) {
+                using variants = typename TStorage::variants;
+                constexpr std::array<std::size_t, sizeof...(TTargets)> next{
+                    variant_index_v<std::conditional_t<std::is_same_v<TTargets, Stay>, TState, TTargets>, variants>...};
+                constexpr std::array<Result, sizeof...(TTargets)> results{
+                    (std::is_same_v<TTargets, Stay> ? Result::Unchanged : Result::Transitioned)...};
+                storage.set_index(next[new_state.index()]);
+                return results[new_state.index()];
+            } else {
+                return visit([&](auto& target) -> Result {
+                    using TTarget = std::remove_cvref_t<decltype(target)>;
+                    if constexpr (std::is_same_v<TTarget, Stay>) {
+                        return Result::Unchanged;
+                    } else if constexpr (std::is_same_v<TTarget, Reject>) {
+                        policy(child, state, event);
+                        return Result::Rejected;
+                    } else {
+                        commit(child, storage, state, event, std::move(target));
+                        return Result::Transitioned;
+                    }
+                }, new_state.target());
+            }
+        }
+
+        // Calls `transition(state, event)` on the child and stores the new state with `storage = new_state`.
+        // A transition may also return `fsm::emplace<State>(args...)` to construct the next state in place, or a
+        // reference to `state` after mutating it in place (an internal transition: only `on_transition` is called).
+        // A missing `transition` overload is resolved to a rejection at compile time, one returning `fsm::Defer` to
+        // `Result::Deferred` without calling it. Without an overload for the state, the one of its closest superstate
+        // is called; hooks still see the state itself.
+        template<typename TPolicy, typename TChild, typename TStorage, typename TState, typename Event>
+        Result step(TPolicy& policy, TChild& child, TStorage& storage, TState& state, Event&& event) {
+            using THandler = handler_t<TChild, TState, Event>;
+            if constexpr (std::is_void_v<THandler>) {
+                policy(child, state, event);
+                return Result::Rejected;
+            } else if constexpr (Defers<TChild, THandler, Event>) {
+                return Result::Deferred;
+            } else {
+                auto& handler_state = [&]() -> THandler& {
+                    if constexpr (std::is_same_v<THandler, TState>)
+                        return state;
+                    else
+                        return shared_state<THandler>;
+                }();
+                decltype(auto) new_state = child.transition(handler_state, std::forward<Event>(event));
+                using TNewState = decltype(new_state);
+                if constexpr (std::is_lvalue_reference_v<TNewState>) {
+                    static_assert(std::is_same_v<std::remove_cvref_t<TNewState>, THandler>,
+                                  "only the current state can be returned by reference");
+                    on_transition(child, state, event, state);
+                } else if constexpr (is_one_of<TNewState>::value) {
+                    return commit_one_of(policy, child, storage, state, event, new_state);
+                } else if constexpr (is_emplace<TNewState>::value) {
+                    using TTo = typename is_emplace<TNewState>::state_type;
+                    static_assert(!HasOnTransition<TChild, TState, std::remove_reference_t<Event>, TTo>,
+                                  "on_transition needs both states alive, return the next state by value instead");
+                    on_exit(child, state);
+                    emplace(storage, std::move(new_state));
+                    retime<TState>(child, get_as<TTo>(storage));
+                    on_entry(child, get_as<TTo>(storage));
+                } else if constexpr (is_optional_v<TNewState>) {
+                    if (!new_state) {
+                        policy(child, state, event);
+                        return Result::Rejected;
+                    }
+                    commit(child, storage, state, event, *std::move(new_state));
+                } else {
+                    commit(child, storage, state, event, std::move(new_state));
+                }
+                return Result::Transitioned;
+            }
+        }
+    }
+
+    namespace dispatch {
+        // resolve the current state with std::visit and let overload resolution pick the transition
+        struct Visit {};
+        // resolve the transition through a constexpr table of function pointers indexed by the state index,
+        // one table per event type, so a transition costs a single indexed indirect call
+        struct JumpTable {};
+    }
+
+    template<typename TChild, typename TVariants, typename TDispatch = dispatch::Visit,
+            typename TPolicy = policy::Ignore, typename TDeferral = deferral::None,
+            typename TPosting = posting::None>
     class Fsm {
     public:
-        template<typename Event>
-        void process(Event&& event)
+        using variants = TVariants;
+
+        // The state machine's own storage (state, policy, deferred and posted events) can be moved with memcpy.
+        // A child whose own members can be too declares `static constexpr bool trivially_relocatable` with it, so
+        // pools may compact instances with memmove (see `fsm::is_trivially_relocatable`).
+        static constexpr bool trivially_relocatable_storage =
+                is_trivially_relocatable_v<detail::state_storage_t<TVariants>> && is_trivially_relocatable_v<TPolicy>
+                && is_trivially_relocatable_v<TDeferral> && is_trivially_relocatable_v<TPosting>;
+
+        template<typename Event> requires (!detail::is_variant_v<std::remove_cvref_t<Event>>)
+        Result process(Event&& event)
         {
-            auto& child = static_cast<TChild&>(*this);
-            // define transition map through different method signatures
-            auto new_state = std::visit(
-                    [&](auto& state) -> std::optional<TVariants> {
-                        // state function goes in derived `transition` method
-                        return child.transition(state, std::forward<Event>(event));
-                        },
-                    m_state);
+            // without its context every transition taking it would be rejected
+            static_assert(std::is_void_v<detail::context_of_t<TChild>>,
+                          "a child declaring `using context` is driven with `process(event, context)`");
+            return process_with(static_cast<TChild&>(*this), std::forward<Event>(event));
+        }
+
+        // entry point for events only known at runtime: the state and the event alternative are resolved together
+        // through one flattened [state][event] table, regardless of the dispatch backend
+        template<typename... Events>
+        Result process(const std::variant<Events...>& event)
+        {
+            // without its context every transition taking it would be rejected
+            static_assert(std::is_void_v<detail::context_of_t<TChild>>,
+                          "a child declaring `using context` is driven with `process(event, context)`");
+            return process_with(static_cast<TChild&>(*this), event);
+        }
+
+        // Passes `context`, e.g. the account ledger, a clock or a metrics sink shared by many instances, to every
+        // transition declared as `transition(state, event, context)`, including the ones taken by deferred and posted
+        // events. The child declares its type with `using context = ...`. Transitions without a context are still
+        // called with two arguments.
+        template<typename Event, typename TContext> requires std::is_same_v<TContext, detail::context_of_t<TChild>>
+        Result process(Event&& event, TContext& context)
+        {
+            detail::WithContext<TChild, TContext> child{static_cast<TChild&>(*this), context};
+            return process_with(child, std::forward<Event>(event));
+        }
 
-            if(new_state) {
-                m_state = *std::move(new_state);
+        // Like `process`, and sets bit `i` of `entered` for every `i`-th state entered before it returns, including
+        // states entered and left again by replayed deferred events or by posted events. Every transition takes the
+        // hook path meanwhile.
+        template<typename Event, typename... TContext>
+        Result process_recording(std::uint64_t& entered, Event&& event, TContext&... context)
+        {
+            static_assert(std::variant_size_v<TVariants> <= 64, "entered states are recorded as a 64 bit mask");
+            if constexpr (sizeof...(TContext) == 0) {
+                static_assert(std::is_void_v<detail::context_of_t<TChild>>,
+                              "a child declaring `using context` is driven with `process(event, context)`");
+                detail::RecordingEntries<TChild, TVariants> child{static_cast<TChild&>(*this), entered};
+                return process_with(child, std::forward<Event>(event));
+            } else {
+                static_assert(std::is_same_v<std::tuple<TContext...>, std::tuple<detail::context_of_t<TChild>>>,
+                              "the context is the one the child declares with `using context`");
+                detail::WithContext<TChild, TContext...> bound{static_cast<TChild&>(*this), context...};
+                detail::RecordingEntries<decltype(bound), TVariants> child{bound, entered};
+                return process_with(child, std::forward<Event>(event));
             }
         }
+
+        // calls `f` with the current state
+        template<typename F>
+        decltype(auto) visit(F&& f) { return detail::visit(std::forward<F>(f), m_state); }
+
+        std::size_t state_index() const { return m_state.index(); }
+        template<typename TState>
+        bool is_in() const { return m_state.index() == detail::variant_index_v<TState, TVariants>; }
+        // The current state handles none of the events the child declares with `using events`, e.g. a filled order.
+        // Computed at compile time: events for a terminal instance are rejected with a single test of the state index.
+        bool is_terminal() const {
+            return detail::terminal_states<detail::bound_t<TChild>, TVariants>::contains(m_state.index());
+        }
+
+        const TPolicy& rejection_policy() const { return m_policy; }
+        // number of events waiting for a state change
+        std::size_t deferred() const {
+            if constexpr (std::is_same_v<TDeferral, deferral::None>)
+                return 0;
+            else
+                return m_deferral.pending.size();
+        }
+    protected:
+        // For transitions: raise `event` once the current transition is done. Returns false when the queue of
+        // posted events is full.
+        template<typename Event>
+        bool post(Event&& event) {
+            static_assert(!std::is_same_v<TPosting, posting::None>, "posting events needs a posting::Queue");
+            return m_posting.posted.try_emplace(std::in_place_type<std::remove_cvref_t<Event>>,
+                                                std::forward<Event>(event));
+        }
     private:
-        TVariants m_state;
+        // a single byte when no state carries data, the state variant otherwise
+        detail::state_storage_t<TVariants> m_state;
+        [[no_unique_address]] TPolicy m_policy;
+        [[no_unique_address]] TDeferral m_deferral;
+        [[no_unique_address]] TPosting m_posting;
+
+        template<typename Event>
+        static constexpr bool can_reject_terminal = detail::terminal_states<detail::bound_t<TChild>, TVariants>::any
+                && detail::is_declared_event<Event, typename detail::events_of<TChild>::type>::value;
+
+        // `child` is the child itself, or the child bound to the context `process` was called with
+        template<typename TBound, typename Event>
+        Result process_with(TBound& child, Event&& event)
+        {
+            if constexpr (can_reject_terminal<std::remove_cvref_t<Event>>) {
+                if (is_terminal()) [[unlikely]]
+                    return reject_terminal(child, event);
+            }
+            Result result;
+            if constexpr (detail::is_variant_v<std::remove_cvref_t<Event>>) {
+                result = dispatch_variant(child, event);
+            } else if constexpr (std::is_same_v<TDispatch, dispatch::JumpTable>) {
+                result = jump_table<TBound, Event>[m_state.index()](*this, child, event);
+            } else {
+                // define transition map through different method signatures
+                result = detail::visit(
+                        [&](auto& state) -> Result {
+                            // state function goes in derived `transition` method
+                            return detail::step(m_policy, child, m_state, state, std::forward<Event>(event));
+                            },
+                        m_state);
+            }
+            // a deferred event was not passed to any transition, so it is still intact
+            result = settle(child, result, event);
+            process_posted(child);
+            return result;
+        }
+
+        // the rejection policy still sees the event, unless it ignores events anyway
+        template<typename TBound, typename Event>
+        Result reject_terminal(TBound& child, const Event& event) {
+            if constexpr (std::is_same_v<TPolicy, policy::Ignore>) {
+                return Result::Rejected;
+            } else if constexpr (detail::is_variant_v<Event>) {
+                return std::visit([&](const auto& alternative) { return reject_terminal(child, alternative); }, event);
+            } else {
+                detail::visit([&](auto& state) { m_policy(child, state, event); }, m_state);
+                return Result::Rejected;
+            }
+        }
+
+        // events posted while processing one of them are appended and handled by the same loop
+        template<typename TBound>
+        void process_posted(TBound& child) {
+            if constexpr (!std::is_same_v<TPosting, posting::None>) {
+                if (!m_posting.posted.empty()) [[unlikely]]
+                    drain_posted(child);
+            }
+        }
+
+        // kept out of line, so `process` stays small enough to be inlined
+        template<typename TBound>
+        [[gnu::noinline]] void drain_posted(TBound& child) {
+            while (m_posting.posted.try_consume([&](const typename TPosting::events& event) {
+                settle(child, dispatch_variant(child, event), event);
+            })) {}
+        }
+
+        template<typename TBound, typename... Events>
+        Result dispatch_variant(TBound& child, const std::variant<Events...>& event) {
+            return fused_table<TBound, std::variant<Events...>>[m_state.index() * sizeof...(Events) + event.index()](
+                    *this, child, event);
+        }
+
+        // keeps a deferred event, replays the kept ones after a transition
+        template<typename TBound, typename Event>
+        Result settle(TBound& child, Result result, const Event& event) {
+            if constexpr (!std::is_same_v<TDeferral, deferral::None>) {
+                if (result == Result::Deferred) [[unlikely]]
+                    return defer(child, event);
+                if (result == Result::Transitioned && !m_deferral.pending.empty()) [[unlikely]]
+                    replay(child);
+            }
+            return result;
+        }
+
+        template<typename TBound, typename Event>
+        [[gnu::noinline]] Result defer(TBound& child, const Event& event) {
+            if constexpr (detail::is_variant_v<Event>) {
+                return std::visit([&](const auto& alternative) { return defer(child, alternative); }, event);
+            } else if constexpr (detail::is_alternative_v<Event, typename TDeferral::events>) {
+                if (m_deferral.pending.try_emplace(std::in_place_type<Event>, event))
+                    return Result::Deferred;
+                detail::visit([&](auto& state) { m_policy(child, state, event); }, m_state);
+                return Result::Rejected;
+            } else {
+                static_assert(!detail::can_defer_v<TBound, TVariants, const Event&>,
+                              "a deferred event has to be listed in the deferral::Queue");
+                return Result::Rejected;
+            }
+        }
+
+        // Every pass takes each kept event once, in arrival order; the ones deferred again go back in the same
+        // order. Another pass is needed only when a replayed event changed the state.
+        template<typename TBound>
+        [[gnu::noinline]] void replay(TBound& child) {
+            bool transitioned = true;
+            while (transitioned && !m_deferral.pending.empty()) {
+                transitioned = false;
+                for (auto remaining = m_deferral.pending.size(); remaining > 0; remaining--) {
+                    m_deferral.pending.try_consume([&](const typename TDeferral::events& event) {
+                        const auto result = dispatch_variant(child, event);
+                        if (result == Result::Deferred)
+                            m_deferral.pending.try_emplace(event);
+                        transitioned |= result == Result::Transitioned;
+                    });
+                }
+            }
+        }
+
+        // one cell of the jump table: the state alternative is fixed at compile time
+        template<std::size_t StateIndex, typename TBound, typename Event>
+        static Result cell(Fsm& self, TBound& child, Event& event) {
+            return detail::step(self.m_policy, child, self.m_state, detail::get<StateIndex>(self.m_state),
+                                std::forward<Event>(event));
+        }
+
+        template<typename TBound, typename Event, std::size_t... StateIndex>
+        static constexpr auto make_jump_table(std::index_sequence<StateIndex...>) {
+            return std::array<Result (*)(Fsm&, TBound&, Event&), sizeof...(StateIndex)>{
+                &cell<StateIndex, TBound, Event>...};
+        }
+
+        template<typename TBound, typename Event>
+        static constexpr auto jump_table = make_jump_table<TBound, Event>(
+                std::make_index_sequence<std::variant_size_v<TVariants>>{});
+
+        // one cell of the fused table: cell index = state index * number of events + event index
+        template<std::size_t CellIndex, typename TBound, typename EventVariant>
+        static Result fused_cell(Fsm& self, TBound& child, const EventVariant& event) {
+            constexpr auto number_events = std::variant_size_v<EventVariant>;
+            return detail::step(self.m_policy, child, self.m_state,
+                                detail::get<CellIndex / number_events>(self.m_state),
+                                *std::get_if<CellIndex % number_events>(&event));
+        }
+
+        template<typename TBound, typename EventVariant, std::size_t... CellIndex>
+        static constexpr auto make_fused_table(std::index_sequence<CellIndex...>) {
+            return std::array<Result (*)(Fsm&, TBound&, const EventVariant&), sizeof...(CellIndex)>{
+                &fused_cell<CellIndex, TBound, EventVariant>...};
+        }
+
+        template<typename TBound, typename EventVariant>
+        static constexpr auto fused_table = make_fused_table<TBound, EventVariant>(
+                std::make_index_sequence<std::variant_size_v<TVariants> * std::variant_size_v<EventVariant>>{});
     };
 }
 #endif //SRC_FSM_FINITESTATEMACHINE_HPP
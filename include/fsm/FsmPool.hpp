@@ -0,0 +1,252 @@
+#ifndef FSM_FSMPOOL_HPP
+#define FSM_FSMPOOL_HPP
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "FSM.hpp"
+
+namespace fsm {
+    namespace detail {
+        // writes the index of the new state into a state column, used as `storage` by `detail::step`
+        template<typename TVariants>
+        struct StateIndexRef {
+            using variants = TVariants;
+
+            std::uint8_t& index;
+
+            template<typename TState> requires (!is_variant_v<TState>)
+            StateIndexRef& operator=(const TState&) {
+                index = static_cast<std::uint8_t>(variant_index_v<TState, TVariants>);
+                return *this;
+            }
+            StateIndexRef& operator=(const TVariants& state) {
+                index = static_cast<std::uint8_t>(state.index());
+                return *this;
+            }
+            template<typename TState, typename... Args>
+            void emplace(Args&&...) { *this = TState{}; }
+            void set_index(std::size_t new_index) { index = static_cast<std::uint8_t>(new_index); }
+        };
+
+        // Calls `f(index)` for every element of `column` below `limit`, in order. The column is compared 8 (AVX-512)
+        // or 4 (AVX2) elements at a time and only the matches are visited, so a sweep with few matches runs at
+        // the speed of reading the column. `f` may write to the elements it is called for.
+        template<typename F>
+        void for_each_below(std::span<const std::uint64_t> column, std::uint64_t limit, F&& f) {
+            const auto data = column.data();
+            std::size_t i = 0;
+#if defined(__AVX512F__)
+            const auto limits = _mm512_set1_epi64(static_cast<long long>(limit));
+            for (; i + 8 <= column.size(); i += 8) {
+                auto mask = static_cast<unsigned>(_mm512_cmplt_epu64_mask(_mm512_loadu_si512(data + i), limits));
+                for (; mask; mask &= mask - 1)
+                    f(i + static_cast<std::size_t>(std::countr_zero(mask)));
+            }
+#elif defined(__AVX2__)
+            // AVX2 only compares signed integers: flipping the sign bit of both sides keeps the unsigned order
+            const auto sign = _mm256_set1_epi64x(std::numeric_limits<long long>::min());
+            const auto limits = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(limit)), sign);
+            for (; i + 4 <= column.size(); i += 4) {
+                const auto values = _mm256_xor_si256(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), sign);
+                auto mask = static_cast<unsigned>(
+                        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(limits, values))));
+                for (; mask; mask &= mask - 1)
+                    f(i + static_cast<std::size_t>(std::countr_zero(mask)));
+            }
+#endif
+            for (; i < column.size(); i++) {
+                if (data[i] < limit)
+                    f(i);
+            }
+        }
+    }
+
+    // Structure-of-arrays storage for many instances of one state machine whose states carry no data.
+    // The state of every instance is a single byte in a contiguous column, the per-instance data lives in a separate
+    // column of `TChild`, which provides the same `transition` overloads as a `fsm::Fsm` child. A child declaring
+    // `using context` gets its context as the last argument of every `process`, `process_all`, `process_batch` and
+    // `expire_before` call, as with `Fsm::process(event, context)`.
+    template<typename TChild, typename TVariants, typename TPolicy = policy::Ignore>
+    class FsmPool {
+        static_assert(detail::is_stateless_v<TVariants>, "FsmPool stores states as an index, states can't carry data");
+        static_assert(std::variant_size_v<TVariants> <= 256, "FsmPool stores state indices in a byte");
+    public:
+        using Handle = std::uint32_t;
+        using StateIndex = std::uint8_t;
+
+        static constexpr std::uint64_t NO_DEADLINE = std::numeric_limits<std::uint64_t>::max();
+
+        void reserve(std::size_t capacity) {
+            m_states.reserve(capacity);
+            m_instances.reserve(capacity);
+            m_deadlines.reserve(capacity);
+        }
+
+        // new instances start in the first state of `TVariants`, without a deadline
+        template<typename... Args>
+        Handle emplace(Args&&... args) {
+            m_instances.emplace_back(std::forward<Args>(args)...);
+            m_states.push_back(0);
+            m_deadlines.push_back(NO_DEADLINE);
+            return static_cast<Handle>(m_states.size() - 1);
+        }
+
+        std::size_t size() const { return m_states.size(); }
+        TChild& operator[](Handle handle) { return m_instances[handle]; }
+        const TChild& operator[](Handle handle) const { return m_instances[handle]; }
+
+        std::size_t state_index(Handle handle) const { return m_states[handle]; }
+        template<typename TState>
+        bool is_in(Handle handle) const { return m_states[handle] == detail::variant_index_v<TState, TVariants>; }
+        // see `Fsm::is_terminal`
+        bool is_terminal(Handle handle) const {
+            return detail::terminal_states<detail::bound_t<TChild>, TVariants>::contains(m_states[handle]);
+        }
+        // the raw state column, for linear scans
+        std::span<const StateIndex> states() const { return m_states; }
+
+        // deadline column, e.g. the expiry of good till date orders, in a time unit chosen by the user
+        void set_deadline(Handle handle, std::uint64_t deadline) { m_deadlines[handle] = deadline; }
+        std::uint64_t deadline(Handle handle) const { return m_deadlines[handle]; }
+        std::span<const std::uint64_t> deadlines() const { return m_deadlines; }
+
+        template<typename Event, typename... TContext> requires (!detail::is_variant_v<std::remove_cvref_t<Event>>)
+        Result process(Handle handle, Event&& event, TContext&... context) {
+            return jump_table<Event, TContext...>[m_states[handle]](*this, handle, event, context...);
+        }
+
+        template<typename... Events, typename... TContext>
+        Result process(Handle handle, const std::variant<Events...>& event, TContext&... context) {
+            return fused_table<std::variant<Events...>, TContext...>[
+                    m_states[handle] * sizeof...(Events) + event.index()](*this, handle, event, context...);
+        }
+
+        // the same event for every instance in `handles`, returns the number of transitions taken
+        template<typename Event, typename... TContext>
+        std::size_t process(std::span<const Handle> handles, const Event& event, TContext&... context) {
+            std::size_t transitioned = 0;
+            for (auto handle : handles)
+                transitioned += process(handle, event, context...) == Result::Transitioned;
+            return transitioned;
+        }
+
+        // the same event for every instance currently in `TState`, found with a linear scan of the state column;
+        // the state is known at compile time so the transition is called directly
+        template<typename TState, typename Event, typename... TContext>
+        std::size_t process_all(const Event& event, TContext&... context) {
+            constexpr auto index = detail::variant_index_v<TState, TVariants>;
+            std::size_t transitioned = 0;
+            for (std::size_t i = 0; i < m_states.size(); i++) {
+                if (m_states[i] == index)
+                    transitioned += cell<index, const Event>(*this, static_cast<Handle>(i), event, context...)
+                            == Result::Transitioned;
+            }
+            return transitioned;
+        }
+
+        // Events for arbitrary instances, processed in order. The state and data of the instance targeted
+        // `PREFETCH_DISTANCE` events ahead are prefetched, so the cache misses of independent instances overlap
+        // with the dispatch of the current one instead of being paid one after another.
+        // Returns the number of transitions taken.
+        template<typename EventVariant, typename... TContext>
+        std::size_t process_batch(std::span<const std::pair<Handle, EventVariant>> batch, TContext&... context) {
+            std::size_t transitioned = 0;
+            for (std::size_t i = 0; i < PREFETCH_DISTANCE && i < batch.size(); i++)
+                prefetch(batch[i].first);
+            for (std::size_t i = 0; i < batch.size(); i++) {
+                if (i + PREFETCH_DISTANCE < batch.size())
+                    prefetch(batch[i + PREFETCH_DISTANCE].first);
+                transitioned += process(batch[i].first, batch[i].second, context...) == Result::Transitioned;
+            }
+            return transitioned;
+        }
+
+        // Delivers `event` (e.g. `Expired`) to every instance with a deadline before `timestamp`, in handle order, and
+        // clears their deadlines, in a single vectorized pass over the deadline column.
+        // Returns the number of transitions taken.
+        template<typename Event, typename... TContext>
+        std::size_t expire_before(std::uint64_t timestamp, const Event& event, TContext&... context) {
+            std::size_t transitioned = 0;
+            detail::for_each_below(m_deadlines, timestamp, [&](std::size_t i) {
+                m_deadlines[i] = NO_DEADLINE;
+                transitioned += process(static_cast<Handle>(i), event, context...) == Result::Transitioned;
+            });
+            return transitioned;
+        }
+
+        void prefetch(Handle handle) const {
+            __builtin_prefetch(&m_states[handle], 1);
+            __builtin_prefetch(&m_instances[handle], 1);
+        }
+
+        const TPolicy& rejection_policy() const { return m_policy; }
+
+        static constexpr std::size_t PREFETCH_DISTANCE = 8;
+    private:
+        std::vector<StateIndex> m_states;
+        std::vector<TChild> m_instances;
+        std::vector<std::uint64_t> m_deadlines;
+        [[no_unique_address]] TPolicy m_policy;
+
+        template<std::size_t StateIndexValue, typename Event, typename... TContext>
+        static Result cell(FsmPool& self, Handle handle, Event& event, TContext&... context) {
+            auto& state = detail::shared_state<std::variant_alternative_t<StateIndexValue, TVariants>>;
+            detail::StateIndexRef<TVariants> storage{self.m_states[handle]};
+            if constexpr (sizeof...(TContext) == 0) {
+                // without its context every transition taking it would be rejected
+                static_assert(std::is_void_v<detail::context_of_t<TChild>>,
+                              "a child declaring `using context` is driven with `process(handle, event, context)`");
+                return detail::step(self.m_policy, self.m_instances[handle], storage, state,
+                                    std::forward<Event>(event));
+            } else {
+                static_assert(std::is_same_v<std::tuple<TContext...>, std::tuple<detail::context_of_t<TChild>>>,
+                              "the context is the one the child declares with `using context`");
+                detail::WithContext<TChild, TContext...> child{self.m_instances[handle], context...};
+                return detail::step(self.m_policy, child, storage, state, std::forward<Event>(event));
+            }
+        }
+
+        template<typename Event, typename... TContext, std::size_t... StateIndexValue>
+        static constexpr auto make_jump_table(std::index_sequence<StateIndexValue...>) {
+            return std::array<Result (*)(FsmPool&, Handle, Event&, TContext&...), sizeof...(StateIndexValue)>{
+                &cell<StateIndexValue, Event, TContext...>...};
+        }
+
+        template<typename Event, typename... TContext>
+        static constexpr auto jump_table = make_jump_table<Event, TContext...>(
+                std::make_index_sequence<std::variant_size_v<TVariants>>{});
+
+        // cell index = state index * number of events + event index
+        template<std::size_t CellIndex, typename EventVariant, typename... TContext>
+        static Result fused_cell(FsmPool& self, Handle handle, const EventVariant& event, TContext&... context) {
+            constexpr auto number_events = std::variant_size_v<EventVariant>;
+            return cell<CellIndex / number_events>(self, handle, *std::get_if<CellIndex % number_events>(&event),
+                                                   context...);
+        }
+
+        template<typename EventVariant, typename... TContext, std::size_t... CellIndex>
+        static constexpr auto make_fused_table(std::index_sequence<CellIndex...>) {
+            return std::array<Result (*)(FsmPool&, Handle, const EventVariant&, TContext&...), sizeof...(CellIndex)>{
+                &fused_cell<CellIndex, EventVariant, TContext...>...};
+        }
+
+        template<typename EventVariant, typename... TContext>
+        static constexpr auto fused_table = make_fused_table<EventVariant, TContext...>(
+                std::make_index_sequence<std::variant_size_v<TVariants> * std::variant_size_v<EventVariant>>{});
+    };
+}
+#endif //FSM_FSMPOOL_HPP
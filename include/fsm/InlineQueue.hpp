@@ -0,0 +1,87 @@
+#ifndef FSM_INLINEQUEUE_HPP
+#define FSM_INLINEQUEUE_HPP
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "Relocation.hpp"
+
+namespace fsm {
+    // Fixed-capacity FIFO stored inline, for events kept by a state machine itself. Single threaded, never allocates.
+    // Items are constructed in place and consumed by reference, so they only need to be copy or move constructible.
+    template<typename T, std::size_t Capacity>
+    class InlineQueue {
+        static_assert(Capacity > 0);
+    public:
+        // the items live in the queue object itself and nothing points into it
+        static constexpr bool trivially_relocatable = is_trivially_relocatable_v<T>;
+
+        InlineQueue() = default;
+        InlineQueue(const InlineQueue& other) {
+            for (std::size_t i = 0; i < other.m_size; i++)
+                try_emplace(other.at(i));
+        }
+        InlineQueue& operator=(const InlineQueue& other) {
+            if (this != &other) {
+                clear();
+                for (std::size_t i = 0; i < other.m_size; i++)
+                    try_emplace(other.at(i));
+            }
+            return *this;
+        }
+        ~InlineQueue() {
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                clear();
+        }
+
+        // returns false when the queue is full
+        template<typename... Args>
+        bool try_emplace(Args&&... args) {
+            if (m_size == Capacity)
+                return false;
+            ::new (m_slots[slot(m_size)].bytes) T{std::forward<Args>(args)...};
+            m_size++;
+            return true;
+        }
+
+        // calls `consumer(T&)` with the oldest item, then destroys it; the consumer may push new items
+        template<typename F>
+        bool try_consume(F&& consumer) {
+            if (m_size == 0)
+                return false;
+            // take the item out of the queue first, so the consumer can push into the freed slot
+            T item{std::move(at(0))};
+            std::destroy_at(&at(0));
+            m_head = slot(1);
+            m_size--;
+            consumer(item);
+            return true;
+        }
+
+        void clear() {
+            while (try_consume([](T&) {})) {}
+        }
+
+        std::size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        static constexpr std::size_t capacity() { return Capacity; }
+    private:
+        struct Slot {
+            alignas(T) std::byte bytes[sizeof(T)];
+        };
+
+        std::array<Slot, Capacity> m_slots;
+        std::size_t m_head{};
+        std::size_t m_size{};
+
+        std::size_t slot(std::size_t offset) const { return (m_head + offset) % Capacity; }
+        T& at(std::size_t offset) { return *std::launder(reinterpret_cast<T*>(m_slots[slot(offset)].bytes)); }
+        const T& at(std::size_t offset) const {
+            return *std::launder(reinterpret_cast<const T*>(m_slots[slot(offset)].bytes));
+        }
+    };
+}
+#endif //FSM_INLINEQUEUE_HPP
@@ -0,0 +1,182 @@
+#ifndef FSM_INSTANCEPOOL_HPP
+#define FSM_INSTANCEPOOL_HPP
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "FSM.hpp"
+
+namespace fsm {
+    namespace detail {
+        inline constexpr std::size_t SLAB_BYTES = std::size_t{2} << 20;
+
+        // One slab of `SLAB_BYTES`, backed by a huge page where the system has one reserved, otherwise by transparent
+        // huge pages if enabled, otherwise by the heap.
+        class Slab {
+        public:
+            Slab() {
+#if defined(__linux__)
+                m_memory = mmap(nullptr, SLAB_BYTES, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (m_memory == MAP_FAILED) {
+                    m_memory = mmap(nullptr, SLAB_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (m_memory != MAP_FAILED)
+                        madvise(m_memory, SLAB_BYTES, MADV_HUGEPAGE);
+                }
+                if (m_memory != MAP_FAILED) {
+                    m_mapped = true;
+                    return;
+                }
+#endif
+                m_memory = ::operator new(SLAB_BYTES, std::align_val_t{64});
+            }
+            Slab(const Slab&) = delete;
+            Slab& operator=(const Slab&) = delete;
+            ~Slab() {
+#if defined(__linux__)
+                if (m_mapped) {
+                    munmap(m_memory, SLAB_BYTES);
+                    return;
+                }
+#endif
+                ::operator delete(m_memory, std::align_val_t{64});
+            }
+
+            void* data() const { return m_memory; }
+        private:
+            void* m_memory;
+            bool m_mapped{};
+        };
+    }
+
+    // Owns instances of a state machine in slabs of huge pages and recycles an instance as soon as `process` takes
+    // it into a terminal state (see `Fsm::is_terminal`): it is destroyed and its slot goes to the free list, from
+    // which the next `emplace` takes it. Slabs are never returned before the pool is destroyed, so cancel/replace
+    // churn doesn't reach malloc once the pool has grown to the peak number of live instances. A handle carries the
+    // generation of its slot, so a handle to a recycled instance is detected and never dereferenced. The pool has no
+    // locks: each thread owning instances (e.g. a worker of `fsm::ShardedExecutor`) has its own pool, and with it
+    // its own free list.
+    template<typename TFsm>
+    class InstancePool {
+    public:
+        // index of the slot in the lower half, its generation in the upper half
+        using Handle = std::uint64_t;
+
+        static constexpr Handle NO_INSTANCE = std::numeric_limits<Handle>::max();
+
+        InstancePool() = default;
+        InstancePool(const InstancePool&) = delete;
+        InstancePool& operator=(const InstancePool&) = delete;
+        ~InstancePool() {
+            for (std::uint32_t index = 0; index < m_capacity; index++) {
+                if (slot(index).live)
+                    slot(index).instance()->~TFsm();
+            }
+        }
+
+        template<typename... Args>
+        Handle emplace(Args&&... args) {
+            if (m_free == NIL)
+                grow();
+            const auto index = m_free;
+            auto& free = slot(index);
+            m_free = free.next;
+            ::new(static_cast<void*>(free.storage)) TFsm(std::forward<Args>(args)...);
+            free.live = true;
+            m_size++;
+            return static_cast<Handle>(free.generation) << 32 | index;
+        }
+
+        bool contains(Handle handle) const {
+            const auto index = static_cast<std::uint32_t>(handle);
+            return index < m_capacity && slot(index).live
+                   && slot(index).generation == static_cast<std::uint32_t>(handle >> 32);
+        }
+
+        // nullptr for a stale handle
+        TFsm* get(Handle handle) {
+            return contains(handle) ? slot(static_cast<std::uint32_t>(handle)).instance() : nullptr;
+        }
+
+        // A stale handle rejects the event without touching any instance. An instance left in a terminal state is
+        // recycled before `process` returns, whatever the result: a transition that stays may still post an event
+        // ending the instance. `context`, if any, is passed on to `TFsm::process`.
+        template<typename Event, typename... TContext>
+        Result process(Handle handle, Event&& event, TContext&... context) {
+            if (!contains(handle)) [[unlikely]]
+                return Result::Rejected;
+            auto& instance = *slot(static_cast<std::uint32_t>(handle)).instance();
+            const auto result = instance.process(std::forward<Event>(event), context...);
+            if (instance.is_terminal())
+                release(static_cast<std::uint32_t>(handle));
+            return result;
+        }
+
+        // destroys an instance before it reached a terminal state; false for a stale handle
+        bool erase(Handle handle) {
+            if (!contains(handle))
+                return false;
+            release(static_cast<std::uint32_t>(handle));
+            return true;
+        }
+
+        // live instances
+        std::size_t size() const { return m_size; }
+        // slots in the slabs allocated so far
+        std::size_t capacity() const { return m_capacity; }
+    private:
+        static constexpr std::uint32_t NIL = std::numeric_limits<std::uint32_t>::max();
+
+        struct Slot {
+            alignas(TFsm) std::byte storage[sizeof(TFsm)];
+            std::uint32_t generation{};
+            std::uint32_t next{NIL};
+            bool live{};
+
+            TFsm* instance() { return std::launder(reinterpret_cast<TFsm*>(storage)); }
+        };
+
+        static constexpr std::uint32_t SLOTS_PER_SLAB = detail::SLAB_BYTES / sizeof(Slot);
+        static_assert(SLOTS_PER_SLAB > 0, "InstancePool can't fit an instance into a slab");
+        static_assert(alignof(Slot) <= 64, "InstancePool slabs are aligned to 64 bytes");
+
+        std::vector<std::unique_ptr<detail::Slab>> m_slabs;
+        std::uint32_t m_capacity{};
+        std::uint32_t m_free{NIL};
+        std::size_t m_size{};
+
+        Slot& slot(std::uint32_t index) const {
+            return static_cast<Slot*>(m_slabs[index / SLOTS_PER_SLAB]->data())[index % SLOTS_PER_SLAB];
+        }
+
+        void release(std::uint32_t index) {
+            auto& released = slot(index);
+            released.instance()->~TFsm();
+            released.live = false;
+            released.generation++;
+            released.next = m_free;
+            m_free = index;
+            m_size--;
+        }
+
+        // the slots of a new slab are pushed in reverse, so they are handed out in address order
+        [[gnu::noinline]] void grow() {
+            auto slots = static_cast<Slot*>(m_slabs.emplace_back(std::make_unique<detail::Slab>())->data());
+            for (auto i = SLOTS_PER_SLAB; i-- > 0;) {
+                ::new(static_cast<void*>(slots + i)) Slot{};
+                slots[i].next = m_free;
+                m_free = m_capacity + i;
+            }
+            m_capacity += SLOTS_PER_SLAB;
+        }
+    };
+}
+#endif //FSM_INSTANCEPOOL_HPP
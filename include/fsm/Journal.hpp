@@ -0,0 +1,286 @@
+#ifndef FSM_JOURNAL_HPP
+#define FSM_JOURNAL_HPP
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "FSM.hpp"
+
+namespace fsm {
+    namespace detail {
+        // time stamp counter where there is one, the steady clock otherwise
+        inline std::uint64_t read_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+        }
+
+        // FNV-1a over 8 byte words of a multiple of 8 bytes, never 0, so the zeroed tail of a preallocated segment
+        // never passes for a record
+        inline std::uint32_t checksum(const std::byte* data, std::size_t size) {
+            std::uint64_t hash = 14695981039346656037u;
+            for (std::size_t i = 0; i < size; i += sizeof(std::uint64_t)) {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                hash = (hash ^ word) * 1099511628211u;
+            }
+            const auto folded = static_cast<std::uint32_t>(hash ^ hash >> 32);
+            return folded == 0 ? 1 : folded;
+        }
+
+        template<typename TEvent>
+        struct max_event_size;
+        template<typename... Events>
+        struct max_event_size<std::variant<Events...>>: std::integral_constant<std::size_t,
+                std::max({sizeof(Events)...})> {};
+    }
+
+    // Append-only binary journal of the events applied to state machine instances, for crash recovery. Every event
+    // becomes one fixed-size record (TSC timestamp, instance id, event type id = index in `TEvent`, the raw bytes
+    // of the event) written into a memory-mapped segment file that is preallocated and prefaulted, so appending is
+    // a copy into memory. Durability comes from group commit: one msync for all records appended since the previous
+    // commit, done every `records_per_commit` appends or when `commit` is called. A full segment is committed and
+    // the next one, `<directory>/<sequence>.journal`, is started and synced into the directory. Records carry a
+    // checksum, so a record torn by a crash ends the replay of its segment. Single writer; POSIX only.
+    // `TEvent` is a `std::variant` of trivially copyable events.
+    template<typename TEvent>
+    class Journal {
+        static_assert(detail::is_variant_v<TEvent>, "events are stored with the index of their type in a variant");
+    public:
+        static constexpr std::size_t PAYLOAD_BYTES = (detail::max_event_size<TEvent>::value + 7) / 8 * 8;
+
+        struct Record {
+            std::uint64_t timestamp;
+            std::uint64_t instance;
+            std::uint32_t event_type;
+            std::uint32_t checksum;     // of every other byte of the record
+            std::array<std::byte, PAYLOAD_BYTES> payload;
+        };
+
+        // Starts a new segment after the highest numbered one found in `directory`, which is created if missing.
+        explicit Journal(std::filesystem::path directory, std::size_t segment_bytes = std::size_t{64} << 20,
+                         std::size_t records_per_commit = 64)
+        : m_directory(std::move(directory)), m_segment_bytes(std::max(segment_bytes, HEADER_BYTES + sizeof(Record))),
+          m_records_per_commit(std::max<std::size_t>(records_per_commit, 1)) {
+            std::error_code error;
+            std::filesystem::create_directories(m_directory, error);
+            const auto last = last_sequence(m_directory);
+            m_next_sequence = last ? *last + 1 : 0;
+            m_directory_fd = ::open(m_directory.c_str(), O_RDONLY | O_DIRECTORY);
+            open_segment();
+        }
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+        ~Journal() {
+            close_segment();
+            if (m_directory_fd >= 0)
+                ::close(m_directory_fd);
+        }
+
+        // false when no segment could be opened, e.g. the disk is full
+        bool good() const { return m_base != nullptr; }
+
+        // Appends `event`, an alternative of `TEvent` or `TEvent` itself, applied to `instance`. Returns false when the
+        // record couldn't be written.
+        template<typename Event>
+        bool append(std::uint64_t instance, const Event& event) {
+            if (m_size == m_capacity && !roll_over()) [[unlikely]]
+                return false;
+            auto& record = records()[m_size];
+            record.timestamp = detail::read_tsc();
+            record.instance = instance;
+            if constexpr (detail::is_variant_v<Event>)
+                std::visit([&record](const auto& alternative) { store(record, alternative); }, event);
+            else
+                store(record, event);
+            record.checksum = checksum(record);
+            if (++m_size - m_committed >= m_records_per_commit)
+                return commit();
+            return true;
+        }
+
+        // makes every record appended so far durable with one msync over the pages they were written to
+        bool commit() {
+            if (m_committed == m_size)
+                return true;
+            const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            const auto first = offset(m_committed) / page * page;
+            if (msync(m_base + first, offset(m_size) - first, MS_SYNC) != 0)
+                return false;
+            m_committed = m_size;
+            return true;
+        }
+
+        std::uint64_t sequence() const { return m_sequence; }
+        // records in the current segment
+        std::size_t size() const { return m_size; }
+        std::size_t capacity() const { return m_capacity; }
+
+        static std::filesystem::path segment_path(const std::filesystem::path& directory, std::uint64_t sequence) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%012llu.journal", static_cast<unsigned long long>(sequence));
+            return directory / name;
+        }
+
+        // The highest sequence of the segments in `directory`, none when there are none. Segments are replayed from
+        // the first one on up to it; a missing one in between is skipped, not the end of the journal.
+        static std::optional<std::uint64_t> last_sequence(const std::filesystem::path& directory) {
+            std::optional<std::uint64_t> last;
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+                const auto name = entry.path().filename().string();
+                unsigned long long sequence;
+                int length = 0;
+                if (std::sscanf(name.c_str(), "%12llu.journal%n", &sequence, &length) == 1
+                    && static_cast<std::size_t>(length) == name.size())
+                    last = std::max<std::uint64_t>(last.value_or(0), sequence);
+            }
+            return last;
+        }
+
+        // Calls `f(timestamp, instance, event)` for every intact record of a segment, in append order.
+        // Returns the number of records read, 0 for a missing or foreign file.
+        template<typename F>
+        static std::size_t replay(const std::filesystem::path& segment, F&& f) {
+            const auto fd = ::open(segment.c_str(), O_RDONLY);
+            if (fd < 0)
+                return 0;
+            const auto bytes = static_cast<std::size_t>(lseek(fd, 0, SEEK_END));
+            auto base = bytes < HEADER_BYTES ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED)
+                return 0;
+            std::size_t replayed = 0;
+            Header header;
+            std::memcpy(&header, base, sizeof(header));
+            if (header.magic == MAGIC && header.record_bytes == sizeof(Record)) {
+                const auto first = reinterpret_cast<const Record*>(static_cast<const std::byte*>(base) + HEADER_BYTES);
+                const auto count = (bytes - HEADER_BYTES) / sizeof(Record);
+                for (; replayed < count; replayed++) {
+                    const auto& record = first[replayed];
+                    if (record.checksum != checksum(record) || record.event_type >= std::variant_size_v<TEvent>)
+                        break;
+                    f(record.timestamp, record.instance, load(record));
+                }
+            }
+            munmap(base, bytes);
+            return replayed;
+        }
+    private:
+        static constexpr std::uint64_t MAGIC = 0x4c4e524a4d5346;   // "FSMJRNL"
+        static constexpr std::size_t HEADER_BYTES = 64;
+
+        struct Header {
+            std::uint64_t magic;
+            std::uint64_t sequence;
+            std::uint32_t record_bytes;
+        };
+
+        std::filesystem::path m_directory;
+        std::size_t m_segment_bytes;
+        std::size_t m_records_per_commit;
+        // of the open segment, and of the one to open next
+        std::uint64_t m_sequence{};
+        std::uint64_t m_next_sequence{};
+        int m_directory_fd{-1};
+        std::byte* m_base{};
+        std::size_t m_capacity{};
+        std::size_t m_size{};
+        std::size_t m_committed{};
+
+        Record* records() { return reinterpret_cast<Record*>(m_base + HEADER_BYTES); }
+        static std::size_t offset(std::size_t record) { return HEADER_BYTES + record * sizeof(Record); }
+
+        template<typename Event>
+        static void store(Record& record, const Event& event) {
+            static_assert(std::is_trivially_copyable_v<Event>, "journaled events are stored as raw bytes");
+            record.event_type = static_cast<std::uint32_t>(detail::variant_index_v<Event, TEvent>);
+            record.payload = {};
+            std::memcpy(record.payload.data(), &event, sizeof(Event));
+        }
+
+        static TEvent load(const Record& record) {
+            return [&]<std::size_t... EventIndex>(std::index_sequence<EventIndex...>) {
+                constexpr std::array<TEvent (*)(const Record&), sizeof...(EventIndex)> loaders{
+                    [](const Record& record) -> TEvent {
+                        using Event = std::variant_alternative_t<EventIndex, TEvent>;
+                        std::array<std::byte, sizeof(Event)> bytes;
+                        std::memcpy(bytes.data(), record.payload.data(), sizeof(Event));
+                        return TEvent{std::in_place_index<EventIndex>, std::bit_cast<Event>(bytes)};
+                    }...};
+                return loaders[record.event_type](record);
+            }(std::make_index_sequence<std::variant_size_v<TEvent>>{});
+        }
+
+        static std::uint32_t checksum(const Record& record) {
+            auto copy = record;
+            copy.checksum = 0;
+            return detail::checksum(reinterpret_cast<const std::byte*>(&copy), sizeof(Record));
+        }
+
+        // The file gets all its blocks now and every page is mapped, so appends neither allocate nor fault. Its
+        // size and directory entry are synced before any record goes in, or a crash could take the segment with
+        // records already committed to it. A file that couldn't be set up is removed again, so the next attempt
+        // takes the same sequence.
+        bool open_segment() {
+            const auto path = segment_path(m_directory, m_next_sequence);
+            const auto fd = m_directory_fd < 0 ? -1 : ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd < 0)
+                return false;
+            void* base = MAP_FAILED;
+            if (posix_fallocate(fd, 0, static_cast<off_t>(m_segment_bytes)) == 0 && fdatasync(fd) == 0
+                && fsync(m_directory_fd) == 0)
+                base = mmap(nullptr, m_segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED) {
+                ::unlink(path.c_str());
+                return false;
+            }
+            m_base = static_cast<std::byte*>(base);
+            m_sequence = m_next_sequence++;
+            m_capacity = (m_segment_bytes - HEADER_BYTES) / sizeof(Record);
+            m_size = 0;
+            m_committed = 0;
+            const Header header{MAGIC, m_sequence, sizeof(Record)};
+            std::memcpy(m_base, &header, sizeof(header));
+            return true;
+        }
+
+        void close_segment() {
+            if (m_base == nullptr)
+                return;
+            commit();
+            munmap(m_base, m_segment_bytes);
+            m_base = nullptr;
+        }
+
+        // the sequence only advances once the next segment is open, a failed attempt is retried with the same one
+        [[gnu::noinline]] bool roll_over() {
+            close_segment();
+            return open_segment();
+        }
+    };
+}
+#endif //FSM_JOURNAL_HPP
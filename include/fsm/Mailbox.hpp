@@ -0,0 +1,57 @@
+#ifndef FSM_MAILBOX_HPP
+#define FSM_MAILBOX_HPP
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include "FSM.hpp"
+#include "MpscQueue.hpp"
+
+namespace fsm {
+    // Wraps a state machine with a bounded lock-free inbox, so any number of threads can post events for one instance
+    // without a mutex around `process`. Posted events are processed in run-to-completion fashion by the thread that
+    // drains the mailbox, one at a time and in the order they were posted.
+    // `TEvent` is usually a `std::variant` of the events of `TFsm`.
+    template<typename TFsm, typename TEvent, std::size_t Capacity = 1024>
+    class Mailbox {
+    public:
+        template<typename... Args>
+        explicit Mailbox(Args&&... args) : m_fsm(std::forward<Args>(args)...) {}
+
+        // any thread; returns false when the inbox is full
+        template<typename Event>
+        bool post(Event&& event) { return m_inbox.try_emplace(std::forward<Event>(event)); }
+
+        // The thread owning the instance processes every pending event, including the ones posted while draining.
+        // Returns the number of processed events.
+        std::size_t drain() {
+            std::size_t processed = 0;
+            while (m_inbox.try_consume([this](const TEvent& event) { m_fsm.process(event); }))
+                processed++;
+            return processed;
+        }
+
+        // For instances without a fixed owner: the calling thread becomes the owner if nobody else is draining.
+        // An event posted right after a concurrent drain released the instance is picked up by the re-check, so
+        // posting and then calling `try_drain` never leaves an event behind.
+        std::size_t try_drain() {
+            std::size_t processed = 0;
+            while (!m_draining.exchange(true, std::memory_order_seq_cst)) {
+                processed += drain();
+                m_draining.store(false, std::memory_order_seq_cst);
+                if (m_inbox.empty())
+                    break;
+            }
+            return processed;
+        }
+
+        // only safe to use from the thread owning the instance
+        TFsm& fsm() { return m_fsm; }
+        const TFsm& fsm() const { return m_fsm; }
+    private:
+        MpscQueue<TEvent, Capacity> m_inbox;
+        alignas(64) std::atomic<bool> m_draining{};
+        TFsm m_fsm;
+    };
+}
+#endif //FSM_MAILBOX_HPP
@@ -0,0 +1,83 @@
+#ifndef FSM_MPSCQUEUE_HPP
+#define FSM_MPSCQUEUE_HPP
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace fsm {
+    // Bounded lock-free multi-producer single-consumer queue (Vyukov's sequence per cell). Producers claim a cell with
+    // a CAS on the tail and publish it with the cell's sequence, the consumer never writes shared state other than
+    // the sequence of the cell it frees. Like `SpscRing`, items are constructed in place and consumed by reference.
+    template<typename T, std::size_t Capacity>
+    class MpscQueue {
+        static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+    public:
+        MpscQueue() {
+            for (std::size_t i = 0; i < Capacity; i++)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+        ~MpscQueue() {
+            while (try_consume([](T&) {})) {}
+        }
+
+        // any thread; returns false when the queue is full
+        template<typename... Args>
+        bool try_emplace(Args&&... args) {
+            auto tail = m_tail.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true) {
+                cell = &m_cells[tail & (Capacity - 1)];
+                const auto sequence = cell->sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<std::ptrdiff_t>(sequence - tail);
+                if (difference == 0) {
+                    if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (difference < 0)
+                    return false;
+                else
+                    tail = m_tail.load(std::memory_order_relaxed);
+            }
+            ::new (cell->bytes) T{std::forward<Args>(args)...};
+            cell->sequence.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer thread only; calls `consumer(T&)` with the oldest item, then destroys it
+        template<typename F>
+        bool try_consume(F&& consumer) {
+            const auto head = m_head.load(std::memory_order_relaxed);
+            auto& cell = m_cells[head & (Capacity - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+                return false;
+            auto& item = *std::launder(reinterpret_cast<T*>(cell.bytes));
+            consumer(item);
+            std::destroy_at(&item);
+            cell.sequence.store(head + Capacity, std::memory_order_release);
+            m_head.store(head + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // exact on the consumer thread, a hint on any other thread
+        bool empty() const {
+            const auto head = m_head.load(std::memory_order_relaxed);
+            return m_cells[head & (Capacity - 1)].sequence.load(std::memory_order_seq_cst) != head + 1;
+        }
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            alignas(T) std::byte bytes[sizeof(T)];
+        };
+
+        alignas(64) std::atomic<std::size_t> m_tail{};
+        // only written by the consumer, atomic so `empty` can be asked from other threads
+        alignas(64) std::atomic<std::size_t> m_head{};
+        alignas(64) std::array<Cell, Capacity> m_cells;
+    };
+}
+#endif //FSM_MPSCQUEUE_HPP
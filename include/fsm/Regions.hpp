@@ -0,0 +1,100 @@
+#ifndef FSM_REGIONS_HPP
+#define FSM_REGIONS_HPP
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "FSM.hpp"
+
+namespace fsm {
+    namespace detail {
+        // Some state of the region has a transition (of its own or of a superstate) for the event. A region declaring
+        // `using context` is looked at bound to its context, so transitions taking the context count too.
+        template<typename TRegion, typename TVariants, typename TEvent>
+        struct reacts_to;
+        template<typename TRegion, typename... Ts, typename TEvent>
+        struct reacts_to<TRegion, std::variant<Ts...>, TEvent>: std::bool_constant<
+                (!std::is_void_v<handler_t<bound_t<TRegion>, Ts, TEvent>> || ...)> {};
+        template<typename TRegion, typename TEvent>
+        inline constexpr bool reacts_to_v = reacts_to<TRegion, typename TRegion::variants, TEvent>::value;
+
+        // the region at `Index`, constructed in place from a tuple of constructor arguments
+        template<std::size_t Index, typename TRegion>
+        struct RegionSlot {
+            TRegion region;
+
+            template<typename TArgs>
+            RegionSlot(std::piecewise_construct_t, TArgs&& args)
+            : region(std::make_from_tuple<TRegion>(std::forward<TArgs>(args))) {}
+        };
+
+        template<typename TIndices, typename... TRegions>
+        struct RegionSlots;
+        template<std::size_t... Index, typename... TRegions>
+        struct RegionSlots<std::index_sequence<Index...>, TRegions...>: RegionSlot<Index, TRegions>... {
+            template<typename... TArgs>
+            explicit RegionSlots(TArgs&&... args)
+            : RegionSlot<Index, TRegions>(std::piecewise_construct, std::forward<TArgs>(args))... {}
+        };
+    }
+
+    // Orthogonal regions: independent state machines (e.g. the lifecycle and the risk status of an order) driven by
+    // the same events. `process` hands the event to every region in one fold expression; regions without a transition
+    // for the event type in any of their states are left out at compile time. `context`, if any, is passed on to the
+    // regions declaring `using context`.
+    template<typename... TRegions>
+    class Regions: private detail::RegionSlots<std::index_sequence_for<TRegions...>, TRegions...> {
+        using slots = detail::RegionSlots<std::index_sequence_for<TRegions...>, TRegions...>;
+    public:
+        // one tuple of constructor arguments per region, e.g. `std::forward_as_tuple(...)` or `std::tuple{}`
+        template<typename... TArgs> requires (sizeof...(TArgs) == sizeof...(TRegions))
+        explicit Regions(TArgs&&... args): slots(std::forward<TArgs>(args)...) {}
+
+        template<std::size_t Index>
+        auto& get() { return static_cast<detail::RegionSlot<Index, region_t<Index>>&>(*this).region; }
+        template<typename TRegion>
+        TRegion& get() { return get<detail::variant_index_v<TRegion, std::variant<TRegions...>>>(); }
+
+        // `Transitioned` when any region transitioned, otherwise the most significant result of the regions
+        // reacting to the event; `Rejected` when none reacts
+        template<typename Event, typename... TContext> requires (!detail::is_variant_v<std::remove_cvref_t<Event>>)
+        Result process(const Event& event, TContext&... context) {
+            return [&]<std::size_t... Index>(std::index_sequence<Index...>) {
+                Result result = Result::Rejected;
+                ((result = combine(result, dispatch<Index>(event, context...))), ...);
+                return result;
+            }(std::index_sequence_for<TRegions...>{});
+        }
+
+        template<typename... Events, typename... TContext>
+        Result process(const std::variant<Events...>& event, TContext&... context) {
+            return std::visit([&](const auto& alternative) { return process(alternative, context...); }, event);
+        }
+
+        template<typename Event>
+        static constexpr bool reacts_to = (detail::reacts_to_v<TRegions, const Event&> || ...);
+    private:
+        template<std::size_t Index>
+        using region_t = std::tuple_element_t<Index, std::tuple<TRegions...>>;
+
+        template<std::size_t Index, typename Event, typename... TContext>
+        Result dispatch(const Event& event, TContext&... context) {
+            if constexpr (!detail::reacts_to_v<region_t<Index>, const Event&>)
+                return Result::Rejected;
+            else if constexpr (std::is_void_v<detail::context_of_t<region_t<Index>>>)
+                return get<Index>().process(event);
+            else
+                return get<Index>().process(event, context...);
+        }
+
+        static constexpr Result combine(Result lhs, Result rhs) {
+            // indexed by `Result`
+            constexpr std::array<int, 4> rank{3, 1, 0, 2};
+            return rank[static_cast<std::size_t>(lhs)] >= rank[static_cast<std::size_t>(rhs)] ? lhs : rhs;
+        }
+    };
+}
+#endif //FSM_REGIONS_HPP
@@ -0,0 +1,47 @@
+#ifndef FSM_RELOCATION_HPP
+#define FSM_RELOCATION_HPP
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace fsm {
+    // A type whose objects can be moved to another address by copying their bytes, the source then counting as
+    // destroyed ("trivially relocatable", P1144). Trivially copyable types are; a type whose copies would be wrong
+    // but whose relocation isn't, e.g. one with an inline queue, opts in with
+    // `static constexpr bool trivially_relocatable = true;`. Objects pointed to from elsewhere (e.g. by a timer) are
+    // never trivially relocatable.
+    template<typename T>
+    struct is_trivially_relocatable: std::bool_constant<std::is_trivially_copyable_v<T>> {};
+    template<typename T> requires requires { { T::trivially_relocatable } -> std::convertible_to<bool>; }
+    struct is_trivially_relocatable<T>: std::bool_constant<T::trivially_relocatable> {};
+    template<typename... Ts>
+    struct is_trivially_relocatable<std::variant<Ts...>>: std::bool_constant<
+            (is_trivially_relocatable<Ts>::value && ...)> {};
+    template<typename T>
+    struct is_trivially_relocatable<std::optional<T>>: is_trivially_relocatable<T> {};
+    template<typename T>
+    inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+    // Moves `count` objects from `from` to `to` and ends the lifetime of the sources. The ranges may overlap when
+    // `to` lies before `from`. Trivially relocatable objects are moved with a single memmove.
+    template<typename T>
+    void relocate(T* from, T* to, std::size_t count) {
+        if (from == to || count == 0)
+            return;
+        if constexpr (is_trivially_relocatable_v<T>) {
+            std::memmove(static_cast<void*>(to), static_cast<const void*>(from), count * sizeof(T));
+        } else {
+            for (std::size_t i = 0; i < count; i++) {
+                ::new(static_cast<void*>(to + i)) T(std::move(from[i]));
+                std::destroy_at(from + i);
+            }
+        }
+    }
+}
+#endif //FSM_RELOCATION_HPP
@@ -0,0 +1,149 @@
+#ifndef FSM_SHARDEDEXECUTOR_HPP
+#define FSM_SHARDEDEXECUTOR_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Affinity.hpp"
+#include "FSM.hpp"
+#include "SpscRing.hpp"
+
+namespace fsm {
+    // Shard keeping the instances owned by one worker in a hash map, keyed e.g. by order id.
+    template<typename TKey, typename TFsm>
+    class MapShard {
+    public:
+        using key_type = TKey;
+
+        template<typename... Args>
+        TFsm& emplace(const TKey& key, Args&&... args) {
+            return m_instances.try_emplace(key, std::forward<Args>(args)...).first->second;
+        }
+
+        TFsm* find(const TKey& key) {
+            auto instance = m_instances.find(key);
+            return instance == m_instances.end() ? nullptr : &instance->second;
+        }
+
+        // events for unknown keys are rejected
+        template<typename TEvent>
+        Result process(const TKey& key, const TEvent& event) {
+            auto instance = find(key);
+            return instance ? instance->process(event) : Result::Rejected;
+        }
+
+        std::size_t size() const { return m_instances.size(); }
+    private:
+        std::unordered_map<TKey, TFsm> m_instances;
+    };
+
+    // Runs state machine instances on `number_workers` pinned threads. Instances are partitioned by key, every worker
+    // owns one `TShard` (see `MapShard`) and is the only thread touching it. Each producer has its own SPSC ring to
+    // each worker, so submitting is wait-free and events for one key from one producer are processed in order.
+    template<typename TShard, typename TEvent, std::size_t RingCapacity = 4096>
+    class ShardedExecutor {
+    public:
+        using key_type = typename TShard::key_type;
+
+        struct Message {
+            key_type key;
+            TEvent event;
+        };
+
+        // workers are pinned to `cpus[worker]`, or round robin over the available cpus when no cpus are given
+        ShardedExecutor(std::size_t number_workers, std::size_t number_producers, std::span<const int> cpus = {})
+        : m_workers(number_workers), m_number_producers(number_producers) {
+            m_rings.reserve(number_workers * number_producers);
+            for (std::size_t i = 0; i < number_workers * number_producers; i++)
+                m_rings.push_back(std::make_unique<SpscRing<Message, RingCapacity>>());
+            const auto number_cpus = std::max(1u, std::thread::hardware_concurrency());
+            for (std::size_t worker = 0; worker < number_workers; worker++)
+                m_workers[worker].cpu = static_cast<int>(worker < cpus.size() ? cpus[worker] : worker % number_cpus);
+        }
+
+        ShardedExecutor(const ShardedExecutor&) = delete;
+        ShardedExecutor& operator=(const ShardedExecutor&) = delete;
+        ~ShardedExecutor() { stop(); }
+
+        std::size_t number_workers() const { return m_workers.size(); }
+        std::size_t worker_of(const key_type& key) const { return std::hash<key_type>{}(key) % m_workers.size(); }
+
+        // the shard owning `key`; only safe to use while the executor is stopped
+        TShard& shard_of(const key_type& key) { return m_workers[worker_of(key)].shard; }
+        TShard& shard(std::size_t worker) { return m_workers[worker].shard; }
+
+        void start() {
+            m_running.store(true, std::memory_order_release);
+            for (std::size_t worker = 0; worker < m_workers.size(); worker++)
+                m_workers[worker].thread = std::thread([this, worker] { run(worker); });
+        }
+
+        // processes every event submitted so far, then joins the workers
+        void stop() {
+            m_running.store(false, std::memory_order_release);
+            for (auto& worker : m_workers) {
+                if (worker.thread.joinable())
+                    worker.thread.join();
+            }
+        }
+
+        // `producer` must be used by a single thread at a time; returns false when the worker's ring is full
+        bool try_submit(std::size_t producer, const key_type& key, TEvent event) {
+            return ring(worker_of(key), producer).try_emplace(key, std::move(event));
+        }
+
+        void submit(std::size_t producer, const key_type& key, const TEvent& event) {
+            auto& target = ring(worker_of(key), producer);
+            while (!target.try_emplace(key, event))
+                std::this_thread::yield();
+        }
+    private:
+        struct Worker {
+            alignas(64) TShard shard;
+            std::thread thread;
+            int cpu{};
+        };
+
+        // upper bound of events taken from one producer's ring before looking at the next one
+        static constexpr std::size_t BATCH = 64;
+
+        std::vector<Worker> m_workers;
+        std::size_t m_number_producers;
+        std::vector<std::unique_ptr<SpscRing<Message, RingCapacity>>> m_rings;
+        std::atomic<bool> m_running{};
+
+        SpscRing<Message, RingCapacity>& ring(std::size_t worker, std::size_t producer) {
+            return *m_rings[worker * m_number_producers + producer];
+        }
+
+        void run(std::size_t worker) {
+            detail::pin_current_thread(m_workers[worker].cpu);
+            auto& shard = m_workers[worker].shard;
+            auto process = [&shard](Message& message) { shard.process(message.key, message.event); };
+
+            while (true) {
+                // read before draining: once stopped, an empty pass means every submitted event was processed
+                const bool stopping = !m_running.load(std::memory_order_acquire);
+                std::size_t processed = 0;
+                for (std::size_t producer = 0; producer < m_number_producers; producer++) {
+                    auto& source = ring(worker, producer);
+                    for (std::size_t i = 0; i < BATCH && source.try_consume(process); i++)
+                        processed++;
+                }
+                if (processed == 0) {
+                    if (stopping)
+                        return;
+                    std::this_thread::yield();
+                }
+            }
+        }
+    };
+}
+#endif //FSM_SHARDEDEXECUTOR_HPP
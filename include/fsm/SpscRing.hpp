@@ -0,0 +1,74 @@
+#ifndef FSM_SPSCRING_HPP
+#define FSM_SPSCRING_HPP
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace fsm {
+    // Bounded lock-free single-producer single-consumer ring. Each side caches the other side's index, so the shared
+    // cache line is only touched when the ring looks full (producer) or empty (consumer). Items are constructed in
+    // place and consumed by reference, so they only need to be move constructible (events may have const members).
+    template<typename T, std::size_t Capacity>
+    class SpscRing {
+        static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+    public:
+        SpscRing() = default;
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+        ~SpscRing() {
+            while (try_consume([](T&) {})) {}
+        }
+
+        template<typename... Args>
+        bool try_emplace(Args&&... args) {
+            const auto tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head_cache == Capacity) {
+                m_head_cache = m_head.load(std::memory_order_acquire);
+                if (tail - m_head_cache == Capacity)
+                    return false;
+            }
+            ::new (slot(tail)) T{std::forward<Args>(args)...};
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // calls `consumer(T&)` with the oldest item, then destroys it
+        template<typename F>
+        bool try_consume(F&& consumer) {
+            const auto head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail_cache) {
+                m_tail_cache = m_tail.load(std::memory_order_acquire);
+                if (head == m_tail_cache)
+                    return false;
+            }
+            auto& item = *std::launder(reinterpret_cast<T*>(slot(head)));
+            consumer(item);
+            std::destroy_at(&item);
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // only exact when called from the consumer while the producer is idle
+        bool empty() const {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+    private:
+        struct Slot {
+            alignas(T) std::byte bytes[sizeof(T)];
+        };
+
+        // consumer side
+        alignas(64) std::atomic<std::size_t> m_head{};
+        std::size_t m_tail_cache{};
+        // producer side
+        alignas(64) std::atomic<std::size_t> m_tail{};
+        std::size_t m_head_cache{};
+        alignas(64) std::array<Slot, Capacity> m_slots;
+
+        std::byte* slot(std::size_t index) { return m_slots[index & (Capacity - 1)].bytes; }
+    };
+}
+#endif //FSM_SPSCRING_HPP
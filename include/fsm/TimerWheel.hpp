@@ -0,0 +1,269 @@
+#ifndef FSM_TIMERWHEEL_HPP
+#define FSM_TIMERWHEEL_HPP
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace fsm {
+    // Hierarchical timing wheel (Varghese & Lauck) for state timeouts, e.g. expiring good till date orders.
+    // Time is an unsigned tick count chosen by the user (milliseconds, TSC ticks, ...). Level `n` has 64 buckets of
+    // 64^n ticks each, with 11 levels every 64 bit deadline fits, so there is no overflow list. Timers are nodes of
+    // one contiguous array linked into their bucket by index: arming and cancelling are O(1) and allocate only when
+    // the array grows. A timer in a coarse bucket is moved to a finer one when time reaches its bucket.
+    template<typename TPayload>
+    class TimerWheel {
+    public:
+        using payload_type = TPayload;
+        // index of the node in the lower half, its generation in the upper half, so stale ids are detected
+        using TimerId = std::uint64_t;
+
+        static constexpr TimerId NO_TIMER = std::numeric_limits<TimerId>::max();
+
+        explicit TimerWheel(std::uint64_t now = 0): m_now(now) { m_heads.fill(NIL); }
+
+        void reserve(std::size_t timers) { m_nodes.reserve(timers); }
+
+        // Fires on the first `advance` reaching `deadline`. A deadline up to `now()` is due at the next tick, it fires
+        // on the next `advance` to a later time, not on one to `now()` itself.
+        TimerId arm(std::uint64_t deadline, TPayload payload) {
+            std::uint32_t index;
+            if (m_free != NIL) {
+                index = m_free;
+                m_free = m_nodes[index].next;
+            } else {
+                index = static_cast<std::uint32_t>(m_nodes.size());
+                m_nodes.emplace_back();
+            }
+            auto& node = m_nodes[index];
+            node.deadline = deadline;
+            node.payload = std::move(payload);
+            node.armed = true;
+            link(index, m_now + 1);
+            m_size++;
+            return static_cast<TimerId>(node.generation) << 32 | index;
+        }
+
+        // returns false when the timer already fired or was cancelled
+        bool cancel(TimerId id) {
+            if (!is_armed(id))
+                return false;
+            release(static_cast<std::uint32_t>(id));
+            return true;
+        }
+
+        // replaces the payload of an armed timer, keeping its deadline; returns false when it fired or was cancelled
+        bool rebind(TimerId id, TPayload payload) {
+            if (!is_armed(id))
+                return false;
+            m_nodes[static_cast<std::uint32_t>(id)].payload = std::move(payload);
+            return true;
+        }
+
+        bool is_armed(TimerId id) const {
+            const auto index = static_cast<std::uint32_t>(id);
+            return index < m_nodes.size() && m_nodes[index].armed
+                   && m_nodes[index].generation == static_cast<std::uint32_t>(id >> 32);
+        }
+
+        // Moves time forward to `now` and calls `expired(payload)` for every timer with a deadline up to `now`,
+        // in deadline order. The callback may arm and cancel timers. Returns the number of fired timers.
+        template<typename F>
+        std::size_t advance(std::uint64_t now, F&& expired) {
+            std::size_t fired = 0;
+            while (m_now < now) {
+                if (m_size == 0) {
+                    m_now = now;
+                    break;
+                }
+                // skip the ticks at which no bucket fires or cascades
+                m_now = std::min(now, next_tick()) - 1;
+                const auto tick = ++m_now;
+                if ((tick & MASK) == 0)
+                    cascade(1, tick);
+                const auto bucket = static_cast<std::uint32_t>(tick & MASK);
+                while (m_heads[bucket] != NIL) {
+                    const auto index = m_heads[bucket];
+                    auto payload = std::move(m_nodes[index].payload);
+                    release(index);
+                    expired(payload);
+                    fired++;
+                }
+            }
+            return fired;
+        }
+
+        std::uint64_t now() const { return m_now; }
+        std::size_t size() const { return m_size; }
+    private:
+        static constexpr std::uint32_t BITS = 6;
+        static constexpr std::uint32_t SLOTS = 1 << BITS;
+        static constexpr std::uint64_t MASK = SLOTS - 1;
+        static constexpr std::uint32_t LEVELS = (64 + BITS - 1) / BITS;
+        static constexpr std::uint32_t NIL = std::numeric_limits<std::uint32_t>::max();
+
+        struct Node {
+            std::uint64_t deadline{};
+            std::uint32_t prev{NIL};
+            std::uint32_t next{NIL};    // next free node while released
+            std::uint32_t generation{};
+            std::uint16_t bucket{};
+            bool armed{};
+            TPayload payload{};
+        };
+
+        std::uint64_t m_now;
+        std::size_t m_size{};
+        std::uint32_t m_free{NIL};
+        // one bit per non-empty bucket of a level
+        std::array<std::uint64_t, LEVELS> m_occupied{};
+        std::array<std::uint32_t, LEVELS * SLOTS> m_heads;
+        std::vector<Node> m_nodes;
+
+        // The level is the highest group of bits in which the deadline differs from now. `due` is the first tick
+        // whose bucket hasn't fired yet, timers due before it go there.
+        void link(std::uint32_t index, std::uint64_t due) {
+            auto& node = m_nodes[index];
+            std::uint32_t level = 0;
+            std::uint64_t slot = due & MASK;
+            if (node.deadline > due) {
+                level = (static_cast<std::uint32_t>(std::bit_width(node.deadline ^ m_now)) - 1) / BITS;
+                slot = (node.deadline >> (level * BITS)) & MASK;
+            }
+            const auto bucket = static_cast<std::uint32_t>(level * SLOTS + slot);
+            node.bucket = static_cast<std::uint16_t>(bucket);
+            node.prev = NIL;
+            node.next = m_heads[bucket];
+            if (node.next != NIL)
+                m_nodes[node.next].prev = index;
+            m_heads[bucket] = index;
+            m_occupied[level] |= std::uint64_t{1} << slot;
+        }
+
+        void unlink(std::uint32_t index) {
+            auto& node = m_nodes[index];
+            if (node.prev != NIL)
+                m_nodes[node.prev].next = node.next;
+            else
+                m_heads[node.bucket] = node.next;
+            if (node.next != NIL)
+                m_nodes[node.next].prev = node.prev;
+            if (m_heads[node.bucket] == NIL)
+                m_occupied[node.bucket / SLOTS] &= ~(std::uint64_t{1} << (node.bucket % SLOTS));
+        }
+
+        void release(std::uint32_t index) {
+            unlink(index);
+            auto& node = m_nodes[index];
+            node.armed = false;
+            node.generation++;
+            node.payload = TPayload{};
+            node.next = m_free;
+            m_free = index;
+            m_size--;
+        }
+
+        // The first tick after now reaching a non-empty bucket. Buckets never lie behind the current position of their
+        // level, except for timers due on the next tick when the finest level wraps around.
+        std::uint64_t next_tick() const {
+            if ((m_now & MASK) == MASK)
+                return m_now + 1;
+            auto next = std::numeric_limits<std::uint64_t>::max();
+            for (std::uint32_t level = 0; level < LEVELS; level++) {
+                const auto shift = level * BITS;
+                const auto position = (m_now >> shift) & MASK;
+                const auto ahead = position == MASK ? 0 : m_occupied[level] & (~std::uint64_t{0} << (position + 1));
+                if (ahead == 0)
+                    continue;
+                const auto slot = static_cast<std::uint64_t>(std::countr_zero(ahead));
+                const auto turn = shift + BITS >= 64 ? 0 : m_now >> (shift + BITS) << (shift + BITS);
+                next = std::min(next, turn | slot << shift);
+            }
+            return next;
+        }
+
+        // time reached the bucket of `level` starting at `tick`, move its timers to finer levels
+        void cascade(std::uint32_t level, std::uint64_t tick) {
+            if (level == LEVELS)
+                return;
+            const auto slot = (tick >> (level * BITS)) & MASK;
+            if (slot == 0)
+                cascade(level + 1, tick);
+            const auto bucket = static_cast<std::uint32_t>(level * SLOTS + slot);
+            while (m_heads[bucket] != NIL) {
+                const auto index = m_heads[bucket];
+                unlink(index);
+                link(index, tick);
+            }
+        }
+    };
+
+    // The timeout of one state machine instance on a `TimerWheel`. `fsm::Fsm` arms it when the child enters a state
+    // (or superstate) with a `timeout(state)` overload and cancels it when the child leaves that state; the child
+    // exposes it with `state_timer()`. Until `attach` is called arming does nothing.
+    // A moved timer keeps running with the payload it was armed with. A payload pointing at the instance itself is
+    // stale after the move, so such an instance calls `rebind(this)` in its move constructor.
+    template<typename TWheel>
+    class StateTimer {
+    public:
+        using payload_type = typename TWheel::payload_type;
+
+        StateTimer() = default;
+        StateTimer(TWheel& wheel, payload_type payload): m_wheel(&wheel), m_payload(std::move(payload)) {}
+        StateTimer(const StateTimer&) = delete;
+        StateTimer& operator=(const StateTimer&) = delete;
+        // the running timer moves along, still carrying the payload it was armed with, see `rebind`
+        StateTimer(StateTimer&& other) noexcept
+        : m_wheel(other.m_wheel), m_payload(std::move(other.m_payload)),
+          m_id(std::exchange(other.m_id, TWheel::NO_TIMER)) {}
+        StateTimer& operator=(StateTimer&& other) noexcept {
+            if (this != &other) {
+                cancel();
+                m_wheel = other.m_wheel;
+                m_payload = std::move(other.m_payload);
+                m_id = std::exchange(other.m_id, TWheel::NO_TIMER);
+            }
+            return *this;
+        }
+        ~StateTimer() { cancel(); }
+
+        void attach(TWheel& wheel, payload_type payload) {
+            cancel();
+            m_wheel = &wheel;
+            m_payload = std::move(payload);
+        }
+
+        // the payload of this timer from now on, the running timer included
+        void rebind(payload_type payload) {
+            m_payload = std::move(payload);
+            if (m_id != TWheel::NO_TIMER)
+                m_wheel->rebind(m_id, m_payload);
+        }
+
+        // no deadline means no timeout in this state
+        void arm(std::optional<std::uint64_t> deadline) {
+            cancel();
+            if (m_wheel && deadline)
+                m_id = m_wheel->arm(*deadline, m_payload);
+        }
+
+        void cancel() {
+            if (m_id != TWheel::NO_TIMER) {
+                m_wheel->cancel(m_id);
+                m_id = TWheel::NO_TIMER;
+            }
+        }
+
+        bool armed() const { return m_id != TWheel::NO_TIMER && m_wheel->is_armed(m_id); }
+    private:
+        TWheel* m_wheel{};
+        payload_type m_payload{};
+        typename TWheel::TimerId m_id{TWheel::NO_TIMER};
+    };
+}
+#endif //FSM_TIMERWHEEL_HPP
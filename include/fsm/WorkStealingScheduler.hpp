@@ -0,0 +1,181 @@
+#ifndef FSM_WORKSTEALINGSCHEDULER_HPP
+#define FSM_WORKSTEALINGSCHEDULER_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Affinity.hpp"
+#include "ChaseLevDeque.hpp"
+#include "FSM.hpp"
+#include "MpscQueue.hpp"
+
+namespace fsm {
+    // Runs state machine instances with pending events on a pool of pinned workers that steal work from each other.
+    // Every instance has its own MPSC inbox. An instance with pending events is scheduled exactly once: it sits in
+    // the deque of one worker, or is being drained by one worker, so its events are processed one at a time and in
+    // the order they were submitted. Idle workers steal whole instances from the top of other workers' deques,
+    // never single events, so a hot instance can't be split but everything queued behind it can move.
+    template<typename TFsm, typename TEvent, std::size_t InboxCapacity = 256>
+    class WorkStealingScheduler {
+    public:
+        using Handle = std::uint32_t;
+
+        // workers are pinned to `cpus[worker]`, or round robin over the available cpus when no cpus are given
+        explicit WorkStealingScheduler(std::size_t number_workers, std::span<const int> cpus = {}) {
+            const auto number_cpus = std::max(1u, std::thread::hardware_concurrency());
+            for (std::size_t worker = 0; worker < number_workers; worker++) {
+                m_workers.push_back(std::make_unique<Worker>());
+                m_workers[worker]->cpu = static_cast<int>(worker < cpus.size() ? cpus[worker] : worker % number_cpus);
+            }
+        }
+
+        WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+        WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+        ~WorkStealingScheduler() { stop(); }
+
+        // only while the scheduler is stopped; instances start on worker `handle % number_workers`
+        template<typename... Args>
+        Handle emplace(Args&&... args) {
+            m_instances.emplace_back(std::forward<Args>(args)...);
+            return static_cast<Handle>(m_instances.size() - 1);
+        }
+
+        std::size_t size() const { return m_instances.size(); }
+        std::size_t number_workers() const { return m_workers.size(); }
+        // only safe to use while the scheduler is stopped or idle
+        TFsm& operator[](Handle handle) { return m_instances[handle].fsm; }
+
+        void start() {
+            // every instance is in at most one deque at a time
+            for (auto& worker : m_workers)
+                worker->deque = std::make_unique<ChaseLevDeque<Instance*>>(m_instances.size() + 1);
+            m_running.store(true, std::memory_order_release);
+            for (std::size_t worker = 0; worker < m_workers.size(); worker++)
+                m_workers[worker]->thread = std::thread([this, worker] { run(worker); });
+        }
+
+        // processes every event submitted so far, then joins the workers; events submitted to a scheduler that was
+        // never started stay in their inboxes
+        void stop() {
+            if (m_running.load(std::memory_order_acquire)) {
+                while (!idle())
+                    std::this_thread::yield();
+            }
+            m_running.store(false, std::memory_order_release);
+            for (auto& worker : m_workers) {
+                if (worker->thread.joinable())
+                    worker->thread.join();
+            }
+        }
+
+        // no instance has pending events
+        bool idle() const { return m_scheduled.load(std::memory_order_acquire) == 0; }
+
+        // any thread; waits while the instance's inbox is full
+        template<typename Event>
+        void submit(Handle handle, Event&& event) {
+            auto& instance = m_instances[handle];
+            while (!instance.inbox.try_emplace(std::forward<Event>(event)))
+                std::this_thread::yield();
+            if (!instance.scheduled.exchange(true, std::memory_order_seq_cst)) {
+                m_scheduled.fetch_add(1, std::memory_order_relaxed);
+                auto& injected = m_workers[handle % m_workers.size()]->injected;
+                while (!injected.try_emplace(&instance))
+                    std::this_thread::yield();
+            }
+        }
+    private:
+        struct Instance {
+            template<typename... Args>
+            explicit Instance(Args&&... args) : fsm(std::forward<Args>(args)...) {}
+
+            MpscQueue<TEvent, InboxCapacity> inbox;
+            alignas(64) std::atomic<bool> scheduled{};
+            TFsm fsm;
+        };
+
+        struct Worker {
+            // instances scheduled by submitting threads, moved to the deque by the worker
+            MpscQueue<Instance*, 4096> injected;
+            std::unique_ptr<ChaseLevDeque<Instance*>> deque;
+            std::thread thread;
+            int cpu{};
+        };
+
+        // upper bound of events drained from one instance before it goes back to the deque, where it can be stolen
+        static constexpr std::size_t BUDGET = 64;
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        // stable addresses, instances are never moved
+        std::deque<Instance> m_instances;
+        alignas(64) std::atomic<std::int64_t> m_scheduled{};
+        std::atomic<bool> m_running{};
+
+        // an instance that doesn't fit into the worker's deque any more is returned to be drained right away
+        Instance* next(std::size_t worker) {
+            auto& self = *m_workers[worker];
+            if (auto instance = self.deque->pop())
+                return *instance;
+            Instance* overflow = nullptr;
+            const auto inject = [&self, &overflow](Instance* instance) {
+                if (!self.deque->push(instance))
+                    overflow = instance;
+            };
+            for (std::size_t i = 0; i < BUDGET && overflow == nullptr && self.injected.try_consume(inject); i++) {}
+            if (overflow != nullptr)
+                return overflow;
+            if (auto instance = self.deque->pop())
+                return *instance;
+            for (std::size_t i = 1; i < m_workers.size(); i++) {
+                if (auto instance = m_workers[(worker + i) % m_workers.size()]->deque->steal())
+                    return *instance;
+            }
+            return nullptr;
+        }
+
+        // An instance still having events goes back to the deque; when the deque is full the worker keeps draining
+        // it instead, so a scheduled instance is never dropped.
+        void drain(std::size_t worker, Instance& instance) {
+            auto& deque = *m_workers[worker]->deque;
+            while (true) {
+                std::size_t processed = 0;
+                while (processed < BUDGET && instance.inbox.try_consume([&instance](const TEvent& event) {
+                    instance.fsm.process(event);
+                }))
+                    processed++;
+                if (processed == BUDGET) {
+                    if (deque.push(&instance))
+                        return;
+                    continue;
+                }
+                instance.scheduled.store(false, std::memory_order_seq_cst);
+                // an event submitted after the inbox looked empty, whose submitter saw the instance still scheduled
+                if (!instance.inbox.empty() && !instance.scheduled.exchange(true, std::memory_order_seq_cst)) {
+                    if (deque.push(&instance))
+                        return;
+                    continue;
+                }
+                m_scheduled.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+        }
+
+        void run(std::size_t worker) {
+            detail::pin_current_thread(m_workers[worker]->cpu);
+            while (m_running.load(std::memory_order_acquire)) {
+                if (auto instance = next(worker))
+                    drain(worker, *instance);
+                else
+                    std::this_thread::yield();
+            }
+        }
+    };
+}
+#endif //FSM_WORKSTEALINGSCHEDULER_HPP